@@ -0,0 +1,15 @@
+function c(l){document.getElementById('s').value=l.innerText||l.textContent;document.getElementById('p').focus();}
+// keeps the network list (#n) and a connect attempt (#w) live from /api/v2/wifi/events
+document.addEventListener('DOMContentLoaded',function(){
+var n=document.getElementById('n'),w=document.getElementById('w'),m={},t=0;
+if(!(n||w)||!window.EventSource)return;
+var e=new EventSource('/api/v2/wifi/events');
+function put(a){var d=m[a.id];if(!d){d=m[a.id]=document.createElement('div');d.innerHTML="<a href='#p' onclick='c(this)'></a>&nbsp;<span></span>";d.firstChild.textContent=a.ssid;d.lastChild.className='q'+(a.secure?' l':'');}d.q=a.quality;d.lastChild.textContent=a.quality+'%';}
+function draw(){var l=[];for(var k in m)l.push(m[k]);l.sort(function(x,y){return y.q-x.q;});n.innerHTML='';if(!l.length)n.textContent='No networks found. Refresh to scan again';for(var i=0;i<l.length;i++)n.appendChild(l[i]);}
+if(n){
+e.addEventListener('networks',function(v){m={};JSON.parse(v.data).forEach(put);draw();});
+e.addEventListener('scan',function(v){var s=JSON.parse(v.data);s.added.forEach(put);s.removed.forEach(function(i){delete m[i];});s.changed.forEach(function(a){if(m[a.id])put(a);});draw();});
+}
+// once the attempt has been seen running, its outcome is on data-next
+if(w)e.addEventListener('state',function(v){var s=JSON.parse(v.data),x=w.getAttribute('data-next');w.textContent=s.state;if(s.pending)t=1;else if(t&&x)location.href=x;});
+});
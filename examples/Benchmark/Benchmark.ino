@@ -0,0 +1,289 @@
+// Measures the library on real hardware and prints one line per result:
+//
+//   BENCH phase=<name> key=value ...
+//
+// The run spans several boots, the sketch restarts itself between phases:
+//   prepare     forget everything, store BENCH_SSID as the saved network
+//   cold        autoConnect without the fast reconnect cache
+//   fast_prime  autoConnect with fast reconnect on, fills the cache
+//   fast        autoConnect from the cache
+//   multi       saved network out of reach, autoConnect falls back to the store
+//   portal      forced scan latency, then requests per second against the
+//               modeless portal, heap minimum and stack high-water marks
+//   power       modeless portal in its own task with power save on. Nothing
+//               is attached for the first BENCH_IDLE_SECONDS, measure the
+//               supply current with a meter then. Afterwards join the
+//               "Benchmark" AP with a phone, join_ms is the time from the
+//               join to the first request the portal got (ESP32 only)
+// boot_ms is millis() when autoConnect returned, connect_ms the time spent in
+// it. The throughput client runs on the device itself, so rps is a lower
+// bound that includes the client's own cost. After the last phase the next
+// reset starts over. Grep the serial log for "BENCH" to collect the results.
+//
+// WARNING: this erases the saved WiFi settings of the board it runs on.
+#if defined(ESP8266)
+#include <ESP8266WiFi.h>          //https://github.com/esp8266/Arduino
+#else
+#include <WiFi.h>
+#endif
+
+//needed for library
+#include <ESPAsyncWebServer.h>
+#include <ESPAsyncWiFiManager.h>         //https://github.com/tzapu/WiFiManager
+
+#define BENCH_SSID "your-ssid"
+#define BENCH_PASS "your-password"
+#define BENCH_SECONDS 5       // per throughput route
+#define BENCH_IDLE_SECONDS 60  // idle window of the power phase
+#define BENCH_JOIN_SECONDS 120 // the phone has this long to join
+#define BENCH_MAGIC 0x57424e43
+
+AsyncWebServer server(80);
+DNSServer dns;
+AsyncWiFiManager wifiManager(&server,&dns);
+
+enum Phase {
+  PHASE_PREPARE,
+  PHASE_COLD,
+  PHASE_FAST_PRIME,
+  PHASE_FAST,
+  PHASE_MULTI,
+  PHASE_PORTAL,
+  PHASE_POWER,
+  PHASE_DONE
+};
+
+struct BenchState {
+  uint32_t magic;
+  uint32_t phase;
+};
+
+// survives ESP.restart(), a power cycle loses it and the run starts over
+#if defined(ESP8266)
+BenchState state;
+#else
+RTC_NOINIT_ATTR BenchState state;
+#endif
+
+const char *const PORTAL_ROUTES[] = {"/wifi", "/api/v2/wifi/scan", "/generate_204"};
+volatile bool clientDone = false;
+volatile unsigned long joinedAt = 0;
+volatile unsigned long firstRequestAt = 0;
+unsigned long powerStart = 0;
+
+void loadState() {
+#if defined(ESP8266)
+  ESP.rtcUserMemoryRead(0, (uint32_t *)&state, sizeof(state));
+#endif
+  if (state.magic != BENCH_MAGIC || state.phase > PHASE_DONE) {
+    state.magic = BENCH_MAGIC;
+    state.phase = PHASE_PREPARE;
+  }
+}
+
+void nextPhase(uint32_t phase) {
+  state.phase = phase;
+#if defined(ESP8266)
+  ESP.rtcUserMemoryWrite(0, (uint32_t *)&state, sizeof(state));
+#endif
+  wifiManager.flushSettings();
+  Serial.flush();
+  ESP.restart();
+}
+
+uint32_t heapMin() {
+#if defined(ESP8266)
+  return ESP.getFreeHeap(); // no low-water mark, current free heap
+#else
+  return ESP.getMinFreeHeap();
+#endif
+}
+
+void timeAutoConnect(const char *phase) {
+  unsigned long start = millis();
+  bool ok = wifiManager.autoConnect("Benchmark");
+  unsigned long end = millis();
+  Serial.printf("BENCH phase=%s ok=%d boot_ms=%lu connect_ms=%lu heap_min=%u\n",
+                phase, ok, end, end - start, heapMin());
+}
+
+#if !defined(ESP8266)
+// one GET, true once the whole response was read
+bool fetch(const char *path) {
+  WiFiClient client;
+  if (!client.connect(WiFi.softAPIP(), 80)) {
+    return false;
+  }
+  client.printf("GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                path, WiFi.softAPIP().toString().c_str());
+  uint8_t buffer[256];
+  unsigned long start = millis();
+  while (client.connected() || client.available()) {
+    if (client.available()) {
+      client.read(buffer, sizeof(buffer));
+    } else if (millis() - start > 2000) {
+      return false;
+    } else {
+      delay(1);
+    }
+  }
+  return true;
+}
+
+// a rewrite is matched against every request before the handlers, this one
+// only notes the first request after a station joined
+class FirstRequest : public AsyncWebRewrite {
+  public:
+    FirstRequest() : AsyncWebRewrite("", "") {}
+    bool match(AsyncWebServerRequest *) {
+      if (joinedAt != 0 && firstRequestAt == 0) {
+        firstRequestAt = millis();
+      }
+      return false;
+    }
+};
+FirstRequest firstRequest;
+
+void clientTask(void *) {
+  for (const char *path : PORTAL_ROUTES) {
+    uint32_t requests = 0;
+    uint32_t failed = 0;
+    unsigned long start = millis();
+    while (millis() - start < BENCH_SECONDS * 1000UL) {
+      if (fetch(path)) {
+        requests++;
+      } else {
+        failed++;
+      }
+    }
+    unsigned long elapsed = millis() - start;
+    Serial.printf("BENCH phase=portal route=%s requests=%u failed=%u rps=%.1f heap_min=%u\n",
+                  path, requests, failed, requests * 1000.0 / elapsed, heapMin());
+  }
+  Serial.printf("BENCH phase=portal stack_client=%u\n", uxTaskGetStackHighWaterMark(NULL));
+  clientDone = true;
+  vTaskDelete(NULL);
+}
+#endif
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println();
+  loadState();
+  wifiManager.setDebugOutput(false);
+  // a failed attempt must not leave the sketch in the portal for good
+  wifiManager.setConfigPortalTimeout(30);
+#if defined(ESP8266)
+  Serial.println("BENCH platform=esp8266");
+#else
+  Serial.println("BENCH platform=esp32");
+#endif
+
+  switch (state.phase) {
+    case PHASE_PREPARE:
+      wifiManager.resetSettings();
+      WiFi.mode(WIFI_STA);
+      WiFi.begin(BENCH_SSID, BENCH_PASS);
+      WiFi.waitForConnectResult();
+      wifiManager.addNetwork(BENCH_SSID, BENCH_PASS);
+      Serial.printf("BENCH phase=prepare ok=%d\n", WiFi.status() == WL_CONNECTED);
+      nextPhase(PHASE_COLD);
+      break;
+    case PHASE_COLD:
+      timeAutoConnect("cold");
+      nextPhase(PHASE_FAST_PRIME);
+      break;
+    case PHASE_FAST_PRIME:
+      wifiManager.setFastReconnect(true);
+      timeAutoConnect("fast_prime");
+      nextPhase(PHASE_FAST);
+      break;
+    case PHASE_FAST:
+      wifiManager.setFastReconnect(true);
+      timeAutoConnect("fast");
+      nextPhase(PHASE_MULTI);
+      break;
+    case PHASE_MULTI:
+      // overwrite the saved network with one that is not there
+      WiFi.mode(WIFI_STA);
+      WiFi.begin("bench-absent-ap", "benchmark");
+      WiFi.disconnect();
+      timeAutoConnect("multi");
+      nextPhase(PHASE_PORTAL);
+      break;
+    case PHASE_PORTAL: {
+      timeAutoConnect("portal_connect");
+      unsigned long start = millis();
+      wifiManager.scanModal();
+      Serial.printf("BENCH phase=scan scan_ms=%lu heap_min=%u\n", millis() - start, heapMin());
+      wifiManager.startConfigPortalModeless("Benchmark", "benchmark");
+#if defined(ESP8266)
+      Serial.println("BENCH phase=portal skipped=1");
+      clientDone = true;
+#else
+      xTaskCreate(clientTask, "bench_client", 4096, NULL, 1, NULL);
+#endif
+      break;
+    }
+    case PHASE_POWER:
+#if defined(ESP8266)
+      Serial.println("BENCH phase=power skipped=1");
+      nextPhase(PHASE_DONE);
+#else
+      wifiManager.setPowerSave(true);
+      wifiManager.setPortalTask(true);
+      WiFi.onEvent([](WiFiEvent_t, WiFiEventInfo_t) {
+        if (joinedAt == 0) {
+          joinedAt = millis();
+        }
+      }, SYSTEM_EVENT_AP_STACONNECTED);
+      wifiManager.startConfigPortalModeless("Benchmark", NULL);
+      // the portal set up the server, the rewrite goes on top
+      server.addRewrite(&firstRequest);
+      powerStart = millis();
+      Serial.printf("BENCH phase=power idle_window_s=%d\n", BENCH_IDLE_SECONDS);
+#endif
+      break;
+    default:
+      Serial.println("BENCH phase=done");
+      // the next reset runs the benchmark again
+      state.phase = PHASE_PREPARE;
+#if defined(ESP8266)
+      ESP.rtcUserMemoryWrite(0, (uint32_t *)&state, sizeof(state));
+#endif
+      break;
+  }
+}
+
+void loop() {
+  if (state.phase == PHASE_POWER) {
+    static bool prompted = false;
+    unsigned long elapsed = millis() - powerStart;
+    if (!prompted && elapsed > BENCH_IDLE_SECONDS * 1000UL) {
+      Serial.println("BENCH phase=power join_now=1");
+      prompted = true;
+    }
+    if (firstRequestAt != 0) {
+      Serial.printf("BENCH phase=power join_ms=%lu heap_min=%u\n", firstRequestAt - joinedAt, heapMin());
+      nextPhase(PHASE_DONE);
+    } else if (elapsed > (BENCH_IDLE_SECONDS + BENCH_JOIN_SECONDS) * 1000UL) {
+      Serial.println("BENCH phase=power joined=0");
+      nextPhase(PHASE_DONE);
+    }
+    delay(100);
+    return;
+  }
+  if (state.phase != PHASE_PORTAL) {
+    return;
+  }
+  wifiManager.loop();
+  if (clientDone) {
+#if !defined(ESP8266)
+    TaskHandle_t asyncTcp = xTaskGetHandle("async_tcp");
+    Serial.printf("BENCH phase=portal stack_async_tcp=%u stack_loop=%u heap_min=%u\n",
+                  asyncTcp != NULL ? uxTaskGetStackHighWaterMark(asyncTcp) : 0,
+                  uxTaskGetStackHighWaterMark(NULL), heapMin());
+#endif
+    nextPhase(PHASE_POWER);
+  }
+}
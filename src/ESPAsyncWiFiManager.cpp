@@ -12,13 +12,146 @@
  **************************************************************/
 
 #include "ESPAsyncWiFiManager.h"
+#include "ESPAsyncWiFiManagerAssets.h"
 #include "ArduinoNvs.h"
 #include "../../../../../include/nvs_conf.h"
 #include <esp_task_wdt.h> // watchdog
+#if !defined(ESP8266)
+#include <esp_heap_caps.h>
+#include <freertos/ringbuf.h>
+#endif
+#include <algorithm>
+#include <new>
+#include <climits>
 
 static int save_attempted = 0;
-static void wifi_stand_alone_request(AsyncWebServerRequest *request);
-static void wifi_stand_alone_deactivate_request(AsyncWebServerRequest *request);
+
+#if WM_LOG_BUFFER > 0 && !defined(ESP8266)
+// shared by all instances, the sink task is the only reader
+static RingbufHandle_t wmLogBuffer = NULL;
+static std::atomic<uint32_t> wmLogDropped(0);
+
+static void wmLogTask(void *arg)
+{
+  RingbufHandle_t buffer = (RingbufHandle_t)arg;
+  for (;;)
+  {
+    size_t length;
+    char *line = (char *)xRingbufferReceive(buffer, &length, portMAX_DELAY);
+    if (line != NULL)
+    {
+      Serial.write((const uint8_t *)line, length);
+      Serial.println();
+      vRingbufferReturnItem(buffer, line);
+    }
+    uint32_t dropped = wmLogDropped.exchange(0);
+    if (dropped > 0)
+    {
+      Serial.printf("*WM: %u log lines dropped\r\n", dropped);
+    }
+  }
+}
+#endif
+
+// FNV-1a, buckets SSIDs for duplicate removal and parameter ids for the save handler
+static uint32_t stringHash(const char *str)
+{
+  uint32_t hash = 2166136261u;
+  for (; *str; str++)
+  {
+    hash = (hash ^ (uint8_t)*str) * 16777619u;
+  }
+  return hash;
+}
+
+// a connection attempt that is still undecided
+static boolean connectPending(uint8_t state)
+{
+  return state == WM_CONNECT_CONNECTING || state == WM_CONNECT_ASSOCIATED;
+}
+
+#if !defined(ESP8266)
+// set on every connect event, wakes up waitForConnect()
+static const EventBits_t WM_CONNECT_EVENT_BIT = 1 << 0;
+
+// Disconnect reasons after which the attempt is over: wrong password, AP
+// gone or refusing us. Anything else (beacon loss, expiry, our own
+// disconnect) the driver retries.
+static boolean hopelessReason(uint8_t reason)
+{
+  switch (reason)
+  {
+  case WIFI_REASON_NO_AP_FOUND:
+  case WIFI_REASON_AUTH_FAIL:
+  case WIFI_REASON_ASSOC_FAIL:
+  case WIFI_REASON_HANDSHAKE_TIMEOUT:
+  case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+  case WIFI_REASON_802_1X_AUTH_FAILED:
+    return true;
+  default:
+    return false;
+  }
+}
+#endif
+
+// dirty bits of the settings cache
+#if WM_FEATURE_STAND_ALONE
+static const uint8_t WM_SETTING_STAND_ALONE = 1 << 0;
+#endif
+static const uint8_t WM_SETTING_NETWORKS = 1 << 1;
+static const uint8_t WM_SETTING_FAST_RECONNECT = 1 << 2;
+
+#if defined(ESP8266)
+#define WM_SETTINGS_LOCK()
+#define WM_SETTINGS_UNLOCK()
+#else
+#define WM_SETTINGS_LOCK() portENTER_CRITICAL(&_settingsLock)
+#define WM_SETTINGS_UNLOCK() portEXIT_CRITICAL(&_settingsLock)
+#endif
+
+static boolean loadFastReconnect(AsyncWiFiManagerFastReconnect *record)
+{
+  return NVS.getBlobSize(WIFI_MANAGER_NVS_FAST_RECONNECT) == sizeof(*record) &&
+         NVS.getBlob(WIFI_MANAGER_NVS_FAST_RECONNECT, (uint8_t *)record, sizeof(*record)) &&
+         record->version == WIFI_MANAGER_FAST_RECONNECT_VERSION;
+}
+
+static void loadNetworks(AsyncWiFiManagerNetworkStore *store)
+{
+  if (NVS.getBlobSize(WIFI_MANAGER_NVS_NETWORKS) == sizeof(*store) &&
+      NVS.getBlob(WIFI_MANAGER_NVS_NETWORKS, (uint8_t *)store, sizeof(*store)) &&
+      store->version == WIFI_MANAGER_NETWORK_STORE_VERSION && store->count <= WIFI_MANAGER_MAX_NETWORKS)
+  {
+    return;
+  }
+  memset(store, 0, sizeof(*store));
+  store->version = WIFI_MANAGER_NETWORK_STORE_VERSION;
+}
+
+static int findNetwork(const AsyncWiFiManagerNetworkStore *store, const char *ssid)
+{
+  for (uint8_t i = 0; i < store->count; i++)
+  {
+    if (strcmp(store->networks[i].ssid, ssid) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// move a network to the front, the others keep their order
+static void promoteNetwork(AsyncWiFiManagerNetworkStore *store, uint8_t i)
+{
+  if (i == 0)
+  {
+    return;
+  }
+  AsyncWiFiManagerStoredNetwork network;
+  memcpy(&network, &store->networks[i], sizeof(network));
+  memmove(&store->networks[1], &store->networks[0], i * sizeof(network));
+  memcpy(&store->networks[0], &network, sizeof(network));
+}
 
 AsyncWiFiManagerParameter::AsyncWiFiManagerParameter(const char *custom)
 {
@@ -26,6 +159,7 @@ AsyncWiFiManagerParameter::AsyncWiFiManagerParameter(const char *custom)
   _placeholder = NULL;
   _length = 0;
   _value = NULL;
+  _inArena = false;
 
   _customHTML = custom;
 }
@@ -57,6 +191,7 @@ void AsyncWiFiManagerParameter::init(const char *id,
   _placeholder = placeholder;
   _length = length;
   _value = new char[length + 1];
+  _inArena = false;
 
   for (unsigned int i = 0; i < length; i++)
   {
@@ -91,434 +226,1789 @@ const char *AsyncWiFiManagerParameter::getCustomHTML()
   return _customHTML;
 }
 
-#ifdef USE_EADNS
-AsyncWiFiManager::AsyncWiFiManager(AsyncWebServer *server,
-                                   AsyncDNSServer *dns) : server(server), dnsServer(dns)
+AsyncWiFiManagerChunkPrint::AsyncWiFiManagerChunkPrint(uint8_t *buffer,
+                                                       size_t size,
+                                                       size_t offset) : _buffer(buffer),
+                                                                        _size(size),
+                                                                        _offset(offset),
+                                                                        _pos(0),
+                                                                        _len(0)
 {
-#else
-AsyncWiFiManager::AsyncWiFiManager(AsyncWebServer *server,
-                                   DNSServer *dns) : server(server), dnsServer(dns)
+}
+
+size_t AsyncWiFiManagerChunkPrint::write(uint8_t c)
 {
-#endif
-  wifiSSIDs = NULL;
-  wifiSSIDscan = true;
-  _modeless = false;
-  shouldscan = true;
+  return write(&c, 1);
 }
 
-void AsyncWiFiManager::addParameter(AsyncWiFiManagerParameter *p)
+size_t AsyncWiFiManagerChunkPrint::write(const uint8_t *buffer, size_t size)
 {
-  _params[_paramsCount] = p;
-  _paramsCount++;
-  DEBUG_WM(F("Adding parameter"));
-  DEBUG_WM(p->getID());
+  size_t end = _pos + size;
+  if (end > _offset && _len < _size)
+  {
+    // part of this write falls into the window
+    size_t skip = (_pos < _offset) ? _offset - _pos : 0;
+    size_t n = std::min(size - skip, _size - _len);
+    memcpy(_buffer + _len, buffer + skip, n);
+    _len += n;
+  }
+  _pos = end;
+  // always report success, otherwise Print stops feeding us
+  return size;
 }
 
-void AsyncWiFiManager::setupConfigPortal()
+size_t AsyncWiFiManagerChunkPrint::length()
 {
-  // dnsServer.reset(new DNSServer());
-  // server.reset(new ESP8266WebServer(80));
-  server->reset();
+  return _len;
+}
 
-  DEBUG_WM(F(""));
-  _configPortalStart = millis();
+// write len bytes of a PROGMEM string
+static void printP(Print &out, PGM_P str, size_t len)
+{
+  char buf[64];
+  while (len > 0)
+  {
+    size_t n = std::min(len, sizeof(buf));
+    memcpy_P(buf, str, n);
+    out.write((const uint8_t *)buf, n);
+    str += n;
+    len -= n;
+  }
+}
 
-  DEBUG_WM(F("Configuring access point... "));
-  DEBUG_WM(_apName);
-  if (_apPassword != NULL)
+AsyncWiFiManagerTemplate::AsyncWiFiManagerTemplate(PGM_P tpl, const char *keys) : _tpl(tpl),
+                                                                                   _spanCount(0)
+{
+  size_t len = strlen_P(tpl);
+  size_t literal = 0; // start of the pending literal span
+  for (size_t i = 0; i + 2 < len; i++)
   {
-    if (strlen(_apPassword) < 8 || strlen(_apPassword) > 63)
+    if (pgm_read_byte(tpl + i) != '{' || pgm_read_byte(tpl + i + 2) != '}')
     {
-      // fail passphrase to short or long!
-      DEBUG_WM(F("Invalid AccessPoint password. Ignoring"));
-      _apPassword = NULL;
+      continue;
     }
-    DEBUG_WM(_apPassword);
+    const char *key = strchr(keys, pgm_read_byte(tpl + i + 1));
+    if (key == NULL)
+    {
+      continue; // not one of ours, keep it as text
+    }
+    if (_spanCount + 2 > WIFI_MANAGER_MAX_TEMPLATE_SPANS)
+    {
+      break; // out of spans, the rest is rendered as text
+    }
+    if (i > literal)
+    {
+      _spans[_spanCount++] = {(uint16_t)literal, (uint16_t)(i - literal), -1};
+    }
+    _spans[_spanCount++] = {(uint16_t)i, 3, (int8_t)(key - keys)};
+    i += 2;
+    literal = i + 1;
   }
-
-  // optional soft ip config
-  if (_ap_static_ip)
+  if (len > literal)
   {
-    DEBUG_WM(F("Custom AP IP/GW/Subnet"));
-    WiFi.softAPConfig(_ap_static_ip, _ap_static_gw, _ap_static_sn);
+    _spans[_spanCount++] = {(uint16_t)literal, (uint16_t)(len - literal), -1};
   }
+}
 
-  if (_apPassword != NULL)
+void AsyncWiFiManagerTemplate::render(Print &out, const char *const *values) const
+{
+  for (uint8_t i = 0; i < _spanCount; i++)
   {
-    WiFi.softAP(_apName, _apPassword); // password option
+    const Span &span = _spans[i];
+    if (span.slot < 0)
+    {
+      printP(out, _tpl + span.offset, span.length);
+    }
+    else if (values[span.slot] != NULL)
+    {
+      out.print(values[span.slot]);
+    }
   }
-  else
+}
+
+// templates are parsed once at startup
+static const AsyncWiFiManagerTemplate headTemplate(WFM_HTTP_HEAD, "v");
+static const AsyncWiFiManagerTemplate itemTemplate(HTTP_ITEM, "vri");
+static const AsyncWiFiManagerTemplate paramTemplate(HTTP_FORM_PARAM, "inplvc");
+
+// Print sink appending to a String, backs the String returning helpers
+class StringPrint : public Print
+{
+public:
+  StringPrint(String &str) : _str(str)
   {
-    WiFi.softAP(_apName);
   }
 
-  delay(500); // without delay I've seen the IP address blank
-  DEBUG_WM(F("AP IP address: "));
-  DEBUG_WM(WiFi.softAPIP());
-
-// setup the DNS server redirecting all the domains to the apIP
-#ifdef USE_EADNS
-  dnsServer->setErrorReplyCode(AsyncDNSReplyCode::NoError);
-#else
-  dnsServer->setErrorReplyCode(DNSReplyCode::NoError);
-#endif
-  if (!dnsServer->start(DNS_PORT, "*", WiFi.softAPIP()))
+  size_t write(uint8_t c)
   {
-    DEBUG_WM(F("Could not start Captive DNS Server!"));
+    _str += (char)c;
+    return 1;
   }
 
-  setInfo();
+private:
+  String &_str;
+};
 
-  // setup web pages: root, wifi config pages, SO captive portal detectors and not found
-  server->on("/wifi",
-             std::bind(&AsyncWiFiManager::handleRoot, this, std::placeholders::_1))
-      .setFilter(ON_AP_FILTER);
-  server->on("/api/v2/wifi/scan",
-             std::bind(&AsyncWiFiManager::handleWifi, this, std::placeholders::_1, true))
-      .setFilter(ON_AP_FILTER);
-  server->on("/api/v2/wifi/save",
-             std::bind(&AsyncWiFiManager::handleWifiSave, this, std::placeholders::_1))
-      .setFilter(ON_AP_FILTER);
-  server->on("/api/v2/wifi/info",
-             std::bind(&AsyncWiFiManager::handleInfo, this, std::placeholders::_1))
-      .setFilter(ON_AP_FILTER);
-  server->on("/api/v2/wifi/reset",
-             std::bind(&AsyncWiFiManager::handleReset, this, std::placeholders::_1))
-      .setFilter(ON_AP_FILTER);
-  server->on("/api/v2/wifi/stand_alone",
-             std::bind(&AsyncWiFiManager::handleStandAlone, this, std::placeholders::_1))
-      .setFilter(ON_AP_FILTER);
-  server->on("/api/v2/wifi/stand_alone_yes", HTTP_GET, [](AsyncWebServerRequest *request)
-  {
-      wifi_stand_alone_request(request);
-  });
-  server->on("/api/v2/wifi/stand_alone_no", HTTP_GET, [](AsyncWebServerRequest *request)
-  {
-      wifi_stand_alone_deactivate_request(request);
-  });
-  server->on("/fwlink",
-             std::bind(&AsyncWiFiManager::handleRoot, this, std::placeholders::_1))
-      .setFilter(ON_AP_FILTER); // Microsoft captive portal. Maybe not needed. Might be handled by notFound handler.
-  server->onNotFound(std::bind(&AsyncWiFiManager::handleNotFound, this, std::placeholders::_1));
-  server->begin(); // web server start
-  DEBUG_WM(F("HTTP server started"));
+AsyncWiFiManagerJsonWriter::AsyncWiFiManagerJsonWriter(Print &out) : _out(out),
+                                                                     _depth(0),
+                                                                     _hasItems(0),
+                                                                     _afterKey(false)
+{
 }
 
-static const char HEX_CHAR_ARRAY[17] = "0123456789ABCDEF";
+void AsyncWiFiManagerJsonWriter::beginObject()
+{
+  separator();
+  _out.print('{');
+  _depth++;
+  _hasItems &= ~(1UL << _depth);
+}
 
-#if !defined(ESP8266)
-/**
-* convert char array (hex values) to readable string by seperator
-* buf:           buffer to convert
-* length:        data length
-* strSeperator   seperator between each hex value
-* return:        formated value as String
-*/
-static String byteToHexString(uint8_t *buf, uint8_t length, String strSeperator = "-")
+void AsyncWiFiManagerJsonWriter::endObject()
 {
-  String dataString = "";
-  for (uint8_t i = 0; i < length; i++)
-  {
-    byte v = buf[i] / 16;
-    byte w = buf[i] % 16;
-    if (i > 0)
-    {
-      dataString += strSeperator;
-    }
-    dataString += String(HEX_CHAR_ARRAY[v]);
-    dataString += String(HEX_CHAR_ARRAY[w]);
-  }
-  dataString.toUpperCase();
-  return dataString;
-} // byteToHexString
+  _depth--;
+  _out.print('}');
+}
 
-String getESP32ChipID()
+void AsyncWiFiManagerJsonWriter::beginArray()
+{
+  separator();
+  _out.print('[');
+  _depth++;
+  _hasItems &= ~(1UL << _depth);
+}
+
+void AsyncWiFiManagerJsonWriter::endArray()
+{
+  _depth--;
+  _out.print(']');
+}
+
+void AsyncWiFiManagerJsonWriter::key(const char *name)
 {
-  uint64_t chipid;
-  chipid = ESP.getEfuseMac(); // the chip ID is essentially its MAC address (length: 6 bytes)
-  uint8_t chipid_size = 6;
-  uint8_t chipid_arr[chipid_size];
-  for (uint8_t i = 0; i < chipid_size; i++)
+  separator();
+  string(name);
+  _out.print(':');
+  _afterKey = true;
+}
+
+void AsyncWiFiManagerJsonWriter::value(const char *str)
+{
+  if (str == NULL)
   {
-    chipid_arr[i] = (chipid >> (8 * i)) & 0xff;
+    null();
+    return;
   }
-  return byteToHexString(chipid_arr, chipid_size, "");
+  separator();
+  string(str);
 }
-#endif
 
-void wifi_stand_alone_request(AsyncWebServerRequest *request)
+void AsyncWiFiManagerJsonWriter::value(const String &str)
 {
-    NVS.setInt(NVS_STAND_ALONE, 1, true);
-    String page = "Search and connect to the network of the machine and open the webinterface: 192.168.10.101";
-    request->send(200, "text/html", page);
-    WiFi.mode(WIFI_AP_STA); // cannot erase if not in STA mode !
-    WiFi.persistent(true);
-#if defined(ESP8266)
-    WiFi.disconnect(true);
-#else
-    WiFi.disconnect(true, true);
-#endif
-    WiFi.persistent(false);
-    delay(200);
-    ESP.restart();
+  value(str.c_str());
 }
 
-void wifi_stand_alone_deactivate_request(AsyncWebServerRequest *request)
+void AsyncWiFiManagerJsonWriter::value(int n)
 {
-    NVS.setInt(NVS_STAND_ALONE, 0, true);
-    String page = "Standalone mode is deactivated. Connect again to the network of the machine and connect the machine to the local wifi.";
-    request->send(200, "text/html", page);
-    delay(200);
-    ESP.restart();
+  value((long)n);
 }
-boolean AsyncWiFiManager::autoConnect(unsigned long maxConnectRetries,
-                                      unsigned long retryDelayMs)
+
+void AsyncWiFiManagerJsonWriter::value(unsigned int n)
 {
-  String ssid = "ESP";
-#if defined(ESP8266)
-  ssid += String(ESP.getChipId());
-#else
-  ssid += getESP32ChipID();
-#endif
-  return autoConnect(ssid.c_str(), NULL);
+  value((unsigned long)n);
 }
 
-boolean AsyncWiFiManager::autoConnect(char const *apName,
-                                      char const *apPassword,
-                                      unsigned long maxConnectRetries,
-                                      unsigned long retryDelayMs)
+void AsyncWiFiManagerJsonWriter::value(long n)
 {
-  DEBUG_WM(F(""));
-
-  // attempt to connect; should it fail, fall back to AP
-  //DEBUG_WM(F("Setting sta mode"));
-  //WiFi.mode(WIFI_STA);
+  separator();
+  _out.print(n);
+}
 
-  for (unsigned long tryNumber = 0; tryNumber < maxConnectRetries; tryNumber++)
-  {
-    DEBUG_WM(F("AutoConnect Try No.:"));
-    DEBUG_WM(tryNumber);
+void AsyncWiFiManagerJsonWriter::value(unsigned long n)
+{
+  separator();
+  _out.print(n);
+}
 
-    if (connectWifi("", "") == WL_CONNECTED)
-    {
-      DEBUG_WM(F("IP Address:"));
-      DEBUG_WM(WiFi.localIP());
-      // connected
-      return true;
-    }
+void AsyncWiFiManagerJsonWriter::value(bool b)
+{
+  separator();
+  _out.print(b ? F("true") : F("false"));
+}
 
-    if (tryNumber + 1 < maxConnectRetries)
-    {
-      // we might connect during the delay
-      unsigned long restDelayMs = retryDelayMs;
-      while (restDelayMs > 0)
-      {
-        esp_task_wdt_reset();
-        if (WiFi.status() == WL_CONNECTED)
-        {
-          DEBUG_WM(F("IP Address (connected during delay):"));
-          DEBUG_WM(WiFi.localIP());
-          return true;
-        }
-        unsigned long thisDelay = std::min(restDelayMs, 100ul);
-        delay(thisDelay);
-        restDelayMs -= thisDelay;
-      }
-    }
-  }
+void AsyncWiFiManagerJsonWriter::value(const IPAddress &ip)
+{
+  separator();
+  _out.print('"');
+  _out.print(ip);
+  _out.print('"');
+}
 
-  return startConfigPortal(apName, apPassword);
+void AsyncWiFiManagerJsonWriter::null()
+{
+  separator();
+  _out.print(F("null"));
 }
 
-void AsyncWiFiManager::staModeSetup()
+void AsyncWiFiManagerJsonWriter::raw(const String &json)
 {
-  setupApiCalls();
-  return;
+  separator();
+  _out.print(json);
 }
 
-void AsyncWiFiManager::setupApiCalls()
+void AsyncWiFiManagerJsonWriter::separator()
 {
-  server->on("/wifi",
-             std::bind(&AsyncWiFiManager::handleRootSTA, this, std::placeholders::_1));
-  server->on("/api/v2/wifi/scan",
-             std::bind(&AsyncWiFiManager::handleWifiSTA, this, std::placeholders::_1, true));
-  server->on("/api/v2/wifi/save",
-             std::bind(&AsyncWiFiManager::handleWifiSaveSTA, this, std::placeholders::_1));
-  server->on("/api/v2/wifi/info",
-             std::bind(&AsyncWiFiManager::handleInfoSTA, this, std::placeholders::_1));
-  server->on("/api/v2/wifi/reset",
-             std::bind(&AsyncWiFiManager::handleResetSTA, this, std::placeholders::_1));
-  server->on("/api/v2/wifi/stand_alone",
-             std::bind(&AsyncWiFiManager::handleStandAloneSTA, this, std::placeholders::_1));
+  if (_afterKey)
+  {
+    _afterKey = false; // value of a member, the comma went before the key
+    return;
+  }
+  if (_hasItems & (1UL << _depth))
+  {
+    _out.print(',');
+  }
+  _hasItems |= 1UL << _depth;
 }
 
-String AsyncWiFiManager::networkListAsString()
+void AsyncWiFiManagerJsonWriter::string(const char *str)
 {
-  String pager;
-  // display networks in page
-  for (int i = 0; i < wifiSSIDCount; i++)
+  _out.print('"');
+  const char *run = str; // start of the pending run of plain characters
+  for (; *str != '\0'; str++)
   {
-    if (wifiSSIDs[i].duplicate == true)
+    uint8_t c = *str;
+    if (c >= 0x20 && c != '"' && c != '\\')
     {
-      continue; // skip dups
+      continue;
     }
-    unsigned int quality = getRSSIasQuality(wifiSSIDs[i].RSSI);
-
-    if (_minimumQuality == 0 || _minimumQuality < quality)
+    _out.write((const uint8_t *)run, str - run);
+    run = str + 1;
+    if (c == '"' || c == '\\')
     {
-      String item = FPSTR(HTTP_ITEM);
-      String rssiQ;
-      rssiQ += quality;
-      item.replace("{v}", wifiSSIDs[i].SSID);
-      item.replace("{r}", rssiQ);
-#if defined(ESP8266)
-      if (wifiSSIDs[i].encryptionType != ENC_TYPE_NONE)
-      {
-#else
-      if (wifiSSIDs[i].encryptionType != WIFI_AUTH_OPEN)
-      {
-#endif
-        item.replace("{i}", "l");
-      }
-      else
-      {
-        item.replace("{i}", "");
-      }
-      pager += item;
+      _out.print('\\');
+      _out.print((char)c);
     }
     else
     {
-      DEBUG_WM(F("Skipping due to quality"));
+      char escape[7];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      _out.print(escape);
     }
   }
-  return pager;
-}
-
-String AsyncWiFiManager::scanModal()
-{
-  shouldscan = true;
-  scan();
-  String pager = networkListAsString();
-  return pager;
+  _out.write((const uint8_t *)run, str - run);
+  _out.print('"');
 }
 
-void AsyncWiFiManager::scan(boolean async)
+#if WM_FEATURE_INFO
+// writes info fields either as <dt>/<dd> pairs or as members of a JSON object
+class InfoWriter
 {
-  if (!shouldscan)
+public:
+  InfoWriter(Print &out, AsyncWiFiManagerJsonWriter *json) : _out(out), _json(json)
   {
-    return;
   }
-  DEBUG_WM(F("About to scan()"));
-  if (wifiSSIDscan)
+
+  template <typename T>
+  void field(const char *key, const __FlashStringHelper *label, const T &value, const __FlashStringHelper *unit = NULL)
   {
-    wifi_ssid_count_t n = WiFi.scanNetworks(async);
-    copySSIDInfo(n);
+    if (_json != NULL)
+    {
+      _json->key(key);
+      _json->value(value);
+      return;
+    }
+    _out.print(F("<dt>"));
+    _out.print(label);
+    _out.print(F("</dt><dd>"));
+    _out.print(value);
+    if (unit != NULL)
+    {
+      _out.print(unit);
+    }
+    _out.print(F("</dd>"));
   }
-}
 
-void AsyncWiFiManager::copySSIDInfo(wifi_ssid_count_t n)
-{
-  if (n == WIFI_SCAN_FAILED)
+  // a field this platform does not provide, null in JSON
+  void missing(const char *key, const __FlashStringHelper *label, const __FlashStringHelper *text)
   {
-    DEBUG_WM(F("scanNetworks returned: WIFI_SCAN_FAILED!"));
+    if (_json != NULL)
+    {
+      _json->key(key);
+      _json->null();
+      return;
+    }
+    _out.print(F("<dt>"));
+    _out.print(label);
+    _out.print(F("</dt><dd>"));
+    _out.print(text);
+    _out.print(F("</dd>"));
   }
-  else if (n == WIFI_SCAN_RUNNING)
+
+private:
+  Print &_out;
+  AsyncWiFiManagerJsonWriter *_json;
+};
+#endif
+
+AsyncWiFiManagerScanPool::AsyncWiFiManagerScanPool() : _front(0)
+{
+  _count[0] = 0;
+  _count[1] = 0;
+  _publishedAt[0] = 0;
+  _publishedAt[1] = 0;
+  _readers[0] = 0;
+  _readers[1] = 0;
+}
+
+WiFiResult *AsyncWiFiManagerScanPool::beginWrite()
+{
+  uint8_t back = 1 - _front;
+  if (_readers[back] != 0)
+  {
+    return NULL;
+  }
+  return _records[back];
+}
+
+void AsyncWiFiManagerScanPool::publish(wifi_ssid_count_t count)
+{
+  uint8_t back = 1 - _front;
+  _count[back] = count;
+  // never 0, that means nothing was published yet
+  _publishedAt[back] = millis() | 1;
+  _front = back;
+}
+
+uint8_t AsyncWiFiManagerScanPool::acquire()
+{
+  while (true)
+  {
+    uint8_t front = _front;
+    _readers[front]++;
+    // a publish between reading _front and pinning it may already have handed
+    // this buffer to the writer, take the new front instead
+    if (front == _front)
+    {
+      return front;
+    }
+    _readers[front]--;
+  }
+}
+
+void AsyncWiFiManagerScanPool::release(uint8_t buffer)
+{
+  _readers[buffer]--;
+}
+
+const WiFiResult *AsyncWiFiManagerScanPool::records(uint8_t buffer)
+{
+  return _records[buffer];
+}
+
+wifi_ssid_count_t AsyncWiFiManagerScanPool::count(uint8_t buffer)
+{
+  return _count[buffer];
+}
+
+unsigned long AsyncWiFiManagerScanPool::publishedAt(uint8_t buffer)
+{
+  return _publishedAt[buffer];
+}
+
+AsyncWiFiManagerScanSnapshot::AsyncWiFiManagerScanSnapshot(AsyncWiFiManagerScanPool *pool) : _pool(pool),
+                                                                                             _buffer(pool->acquire())
+{
+}
+
+AsyncWiFiManagerScanSnapshot::~AsyncWiFiManagerScanSnapshot()
+{
+  _pool->release(_buffer);
+}
+
+const WiFiResult *AsyncWiFiManagerScanSnapshot::records()
+{
+  return _pool->records(_buffer);
+}
+
+wifi_ssid_count_t AsyncWiFiManagerScanSnapshot::count()
+{
+  return _pool->count(_buffer);
+}
+
+boolean AsyncWiFiManagerScanSnapshot::published()
+{
+  return _pool->publishedAt(_buffer) != 0;
+}
+
+unsigned long AsyncWiFiManagerScanSnapshot::publishedAt()
+{
+  return _pool->publishedAt(_buffer);
+}
+
+#if !defined(ESP8266)
+AsyncWiFiManagerDNS::AsyncWiFiManagerDNS() : _queries(0),
+                                             _answered(0),
+                                             _dropped(0),
+                                             _windowStart(0),
+                                             _windowQueries(0),
+                                             _rate(0)
+{
+  memset(_answer, 0, sizeof(_answer));
+}
+
+boolean AsyncWiFiManagerDNS::start(uint16_t port, IPAddress ip)
+{
+  // name: pointer to the question, type A, class IN, TTL 60 s, 4 bytes of address
+  static const uint8_t answer[] = {0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04};
+  memcpy(_answer, answer, sizeof(answer));
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    _answer[sizeof(answer) + i] = ip[i];
+  }
+  if (!_udp.listen(port))
+  {
+    return false;
+  }
+  _udp.onPacket([this](AsyncUDPPacket &packet)
+                { handlePacket(packet); });
+  return true;
+}
+
+void AsyncWiFiManagerDNS::stop()
+{
+  _udp.close();
+}
+
+AsyncWiFiManagerDNSStats AsyncWiFiManagerDNS::stats()
+{
+  AsyncWiFiManagerDNSStats stats;
+  stats.queries = _queries;
+  stats.answered = _answered;
+  stats.dropped = _dropped;
+  // a window that is over and nothing came in since means a quiet second
+  stats.queriesPerSecond = millis() - _windowStart < 2000 ? _rate : 0;
+  return stats;
+}
+
+void AsyncWiFiManagerDNS::handlePacket(AsyncUDPPacket &packet)
+{
+  const uint8_t *query = packet.data();
+  size_t len = packet.length();
+  uint32_t queries = ++_queries;
+  unsigned long now = millis();
+  if (now - _windowStart >= 1000)
+  {
+    _rate = queries - _windowQueries;
+    _windowQueries = queries;
+    _windowStart = now;
+  }
+
+  // a standard query (QR 0, opcode 0) with a single question
+  if (len < 12 || (query[2] & 0xf8) != 0 || query[4] != 0 || query[5] != 1)
+  {
+    _dropped++;
+    return;
+  }
+  size_t end = 12;
+  while (end < len && query[end] != 0)
+  {
+    if ((query[end] & 0xc0) != 0)
+    {
+      end = len; // compression has no place in a question
+      break;
+    }
+    end += query[end] + 1;
+  }
+  end += 5; // root label, type and class
+  uint8_t reply[512];
+  if (end > len || end + sizeof(_answer) > sizeof(reply))
+  {
+    _dropped++;
+    return;
+  }
+
+  memcpy(reply, query, end);
+  reply[2] = 0x84 | (query[2] & 0x01); // response, authoritative, RD echoed
+  reply[3] = 0x00;                    // no error
+  uint16_t type = (query[end - 4] << 8) | query[end - 3];
+  // A or ANY gets the portal address, anything else (AAAA...) an empty
+  // answer so the phone does not sit out a timeout
+  boolean answer = type == 1 || type == 255;
+  reply[6] = 0;
+  reply[7] = answer ? 1 : 0;
+  memset(reply + 8, 0, 4); // EDNS and friends are not echoed
+  size_t replyLen = end;
+  if (answer)
+  {
+    memcpy(reply + end, _answer, sizeof(_answer));
+    replyLen += sizeof(_answer);
+  }
+  if (packet.write(reply, replyLen) == replyLen)
+  {
+    _answered++;
+  }
+  else
+  {
+    _dropped++;
+  }
+}
+#endif
+
+#ifdef USE_EADNS
+AsyncWiFiManager::AsyncWiFiManager(AsyncWebServer *server,
+                                   AsyncDNSServer *dns) : server(server), dnsServer(dns)
+{
+#else
+AsyncWiFiManager::AsyncWiFiManager(AsyncWebServer *server,
+                                   DNSServer *dns) : server(server), dnsServer(dns)
+{
+#endif
+  wifiSSIDscan = true;
+  _modeless = false;
+  shouldscan = true;
+}
+
+AsyncWiFiManager::~AsyncWiFiManager()
+{
+#if !defined(ESP8266)
+  _serviceTimer.stop();
+  // the WiFi event task would call into a manager that is gone
+  if (_connectEventId != 0)
+  {
+    WiFi.removeEvent(_connectEventId);
+  }
+#if WM_FEATURE_STA_API
+  if (_scanEventId != 0)
+  {
+    WiFi.removeEvent(_scanEventId);
+  }
+#endif
+  setPowerSave(false);
+#endif
+  stopPortalTask();
+  flushSettings();
+  // parameters may outlive us, hand their values back
+  for (size_t i = 0; i < _params.size(); i++)
+  {
+    AsyncWiFiManagerParameter *p = _params[i];
+    if (p->_inArena)
+    {
+      char *value = new char[p->_length + 1];
+      memcpy(value, p->_value, p->_length + 1);
+      p->_value = value;
+      p->_inArena = false;
+    }
+  }
+  delete[] _paramValues;
+  delete[] _paramSlots;
+#if !defined(ESP8266)
+  if (_connectEvents != NULL)
+  {
+    vEventGroupDelete(_connectEvents);
+  }
+#endif
+  if (_events != NULL)
+  {
+    server->removeHandler(_events); // the server deletes it
+  }
+}
+
+void AsyncWiFiManager::addParameter(AsyncWiFiManagerParameter *p)
+{
+  if (std::find(_params.begin(), _params.end(), p) != _params.end())
+  {
+    return;
+  }
+  if (p->_id != NULL && !p->_inArena)
+  {
+    // move the value into the arena and drop the parameter's own buffer
+    if (!growParamValues(_paramValuesSize + p->_length + 1))
+    {
+      WM_LOGE(F("No memory for parameter"));
+      WM_LOGE(p->_id);
+      return;
+    }
+    char *value = _paramValues + _paramValuesSize;
+    memcpy(value, p->_value, p->_length + 1);
+    _paramValuesSize += p->_length + 1;
+    delete[] p->_value;
+    p->_value = value;
+    p->_inArena = true;
+  }
+  _params.push_back(p);
+  indexParams();
+  DEBUG_WM(F("Adding parameter"));
+  DEBUG_WM(p->getID());
+}
+
+// the arena grows by doubling, values move and the parameters follow them
+boolean AsyncWiFiManager::growParamValues(size_t size)
+{
+  if (size <= _paramValuesCapacity)
+  {
+    return true;
+  }
+  size_t capacity = std::max(size, 2 * _paramValuesCapacity);
+  char *values = new (std::nothrow) char[capacity];
+  if (values == NULL)
+  {
+    return false;
+  }
+  if (_paramValues != NULL)
+  {
+    memcpy(values, _paramValues, _paramValuesSize);
+    for (size_t i = 0; i < _params.size(); i++)
+    {
+      if (_params[i]->_inArena)
+      {
+        _params[i]->_value = values + (_params[i]->_value - _paramValues);
+      }
+    }
+    delete[] _paramValues;
+  }
+  _paramValues = values;
+  _paramValuesCapacity = capacity;
+  return true;
+}
+
+// rebuild the id table, twice as many slots as parameters keeps probes short
+void AsyncWiFiManager::indexParams()
+{
+  uint16_t slots = 4;
+  while (slots < 2 * _params.size())
+  {
+    slots *= 2;
+  }
+  if (slots != _paramSlotCount)
+  {
+    delete[] _paramSlots;
+    _paramSlots = new uint16_t[slots];
+    _paramSlotCount = slots;
+  }
+  memset(_paramSlots, 0, slots * sizeof(uint16_t));
+  for (size_t i = 0; i < _params.size(); i++)
+  {
+    if (_params[i]->_id == NULL)
+    {
+      continue;
+    }
+    uint16_t slot = stringHash(_params[i]->_id) & (slots - 1);
+    while (_paramSlots[slot] != 0)
+    {
+      slot = (slot + 1) & (slots - 1);
+    }
+    _paramSlots[slot] = i + 1;
+  }
+}
+
+AsyncWiFiManagerParameter *AsyncWiFiManager::findParam(const char *id)
+{
+  if (_paramSlots == NULL)
+  {
+    return NULL;
+  }
+  uint16_t slot = stringHash(id) & (_paramSlotCount - 1);
+  while (_paramSlots[slot] != 0)
+  {
+    AsyncWiFiManagerParameter *p = _params[_paramSlots[slot] - 1];
+    if (strcmp(p->_id, id) == 0)
+    {
+      return p;
+    }
+    slot = (slot + 1) & (_paramSlotCount - 1);
+  }
+  return NULL;
+}
+
+// One pass over the request's arguments. A parameter the form did not send
+// ends up empty, like an empty field.
+void AsyncWiFiManager::saveParams(AsyncWebServerRequest *request)
+{
+  for (size_t i = 0; i < _params.size(); i++)
+  {
+    if (_params[i]->_value != NULL)
+    {
+      _params[i]->_value[0] = 0;
+    }
+  }
+  for (size_t i = 0; i < request->params(); i++)
+  {
+    AsyncWebParameter *arg = request->getParam(i);
+    if (arg->isFile())
+    {
+      continue;
+    }
+    AsyncWiFiManagerParameter *p = findParam(arg->name().c_str());
+    if (p == NULL)
+    {
+      continue;
+    }
+    strncpy(p->_value, arg->value().c_str(), p->_length);
+    p->_value[p->_length] = 0;
+
+    WM_LOGV(F("Parameter"));
+    WM_LOGV(p->_id);
+    WM_LOGV(p->_value);
+  }
+}
+
+// URLs operating systems fetch to find out whether they are behind a captive
+// portal. They get a redirect to the portal so the sign in sheet opens.
+static const char *const PROBE_PATHS[] = {
+    "/generate_204",              // Android, ChromeOS
+    "/gen_204",                   // Android
+    "/hotspot-detect.html",       // Apple
+    "/library/test/success.html", // Apple, older releases
+    "/ncsi.txt",                  // Windows
+    "/connecttest.txt",           // Windows 10 and later
+    "/redirect",                  // Windows 10 and later
+    "/canonical.html",            // Firefox
+    "/success.txt",               // Firefox
+};
+
+void AsyncWiFiManager::setupConfigPortal()
+{
+  // dnsServer.reset(new DNSServer());
+  // server.reset(new ESP8266WebServer(80));
+  server->reset();
+  _events = NULL; // deleted with the other handlers, setupEvents() adds a new one
+
+  DEBUG_WM(F(""));
+  _configPortalStart = millis();
+
+  DEBUG_WM(F("Configuring access point... "));
+  DEBUG_WM(_apName);
+  if (_apPassword != NULL)
+  {
+    if (strlen(_apPassword) < 8 || strlen(_apPassword) > 63)
+    {
+      // fail passphrase to short or long!
+      WM_LOGE(F("Invalid AccessPoint password. Ignoring"));
+      _apPassword = NULL;
+    }
+    DEBUG_WM(_apPassword);
+  }
+
+  // optional soft ip config
+  if (_ap_static_ip)
+  {
+    DEBUG_WM(F("Custom AP IP/GW/Subnet"));
+    WiFi.softAPConfig(_ap_static_ip, _ap_static_gw, _ap_static_sn);
+  }
+
+  if (_channelPlanning)
+  {
+    WiFi.softAP(_apName, _apPassword, planChannel());
+  }
+  else if (_apPassword != NULL)
+  {
+    WiFi.softAP(_apName, _apPassword); // password option
+  }
+  else
+  {
+    WiFi.softAP(_apName);
+  }
+
+  delay(500); // without delay I've seen the IP address blank
+  _portalIP = WiFi.softAPIP();
+  _portalLocation = String("http://") + toStringIp(_portalIP) + String("/wifi");
+  WM_LOGI(F("AP IP address: "));
+  WM_LOGI(_portalIP);
+
+  startDNS();
+
+  setInfo();
+
+  // setup web pages: root, wifi config pages, SO captive portal detectors and not found
+  setupRoutes(WM_MODE_AP);
+  route("/fwlink",
+        std::bind(&AsyncWiFiManager::handleRoot, this, std::placeholders::_1, WM_MODE_AP))
+      .setFilter(ON_AP_FILTER); // Microsoft captive portal. Maybe not needed. Might be handled by notFound handler.
+  for (size_t i = 0; i < sizeof(PROBE_PATHS) / sizeof(PROBE_PATHS[0]); i++)
+  {
+    route(PROBE_PATHS[i],
+          std::bind(&AsyncWiFiManager::handleProbe, this, std::placeholders::_1))
+        .setFilter(ON_AP_FILTER);
+  }
+  server->onNotFound(instrument("(not found)",
+                                std::bind(&AsyncWiFiManager::handleNotFound, this, std::placeholders::_1)));
+  server->begin(); // web server start
+  WM_LOGI(F("HTTP server started"));
+}
+
+static const char HEX_CHAR_ARRAY[17] = "0123456789ABCDEF";
+
+#if !defined(ESP8266)
+// the chip ID is essentially its MAC address, as 12 hex digits
+static void formatESP32ChipID(char *out)
+{
+  uint64_t chipid = ESP.getEfuseMac();
+  for (uint8_t i = 0; i < 6; i++)
+  {
+    uint8_t b = (chipid >> (8 * i)) & 0xff;
+    out[2 * i] = HEX_CHAR_ARRAY[b >> 4];
+    out[2 * i + 1] = HEX_CHAR_ARRAY[b & 0xf];
+  }
+  out[12] = '\0';
+}
+
+String getESP32ChipID()
+{
+  char id[13];
+  formatESP32ChipID(id);
+  return String(id);
+}
+#endif
+
+boolean AsyncWiFiManager::autoConnect(unsigned long maxConnectRetries,
+                                      unsigned long retryDelayMs)
+{
+  String ssid = "ESP";
+#if defined(ESP8266)
+  ssid += String(ESP.getChipId());
+#else
+  ssid += getESP32ChipID();
+#endif
+  return autoConnect(ssid.c_str(), NULL);
+}
+
+boolean AsyncWiFiManager::autoConnect(char const *apName,
+                                      char const *apPassword,
+                                      unsigned long maxConnectRetries,
+                                      unsigned long retryDelayMs)
+{
+  startLogSink();
+  loadSettings();
+  DEBUG_WM(F(""));
+
+  // attempt to connect; should it fail, fall back to AP
+  //DEBUG_WM(F("Setting sta mode"));
+  //WiFi.mode(WIFI_STA);
+
+  // every attempt gets cut short at the time to portal
+  _connectDeadline = _maxTimeToPortal != 0 ? (millis() + _maxTimeToPortal) | 1 : 0;
+  unsigned long backoff = retryDelayMs;
+  for (unsigned long tryNumber = 0; tryNumber < maxConnectRetries && connectTimeLeft() > 1; tryNumber++)
+  {
+    DEBUG_WM(F("AutoConnect Try No.:"));
+    DEBUG_WM(tryNumber);
+
+    if (connectWifi("", "") == WL_CONNECTED)
+    {
+      WM_LOGI(F("IP Address:"));
+      WM_LOGI(WiFi.localIP());
+      // connected
+      _connectDeadline = 0;
+      flushSettings();
+      return true;
+    }
+
+    // the first failure falls over to the other stored networks
+    if (tryNumber == 0 && connectKnownNetwork())
+    {
+      WM_LOGI(F("IP Address:"));
+      WM_LOGI(WiFi.localIP());
+      _connectDeadline = 0;
+      flushSettings();
+      return true;
+    }
+
+    if (tryNumber + 1 < maxConnectRetries && backoff > 0)
+    {
+      // exponential backoff with jitter, so devices that lost power together
+      // do not all come back to the AP in the same instant
+      unsigned long wait = std::min(backoff / 2 + random(backoff / 2 + 1), connectTimeLeft());
+      backoff = std::min(backoff * 2, (unsigned long)WIFI_MANAGER_MAX_RETRY_DELAY);
+      // we might connect during the delay
+      if (waitForConnect(wait, true) == WM_CONNECT_CONNECTED)
+      {
+        WM_LOGI(F("IP Address (connected during delay):"));
+        WM_LOGI(WiFi.localIP());
+        _connectDeadline = 0;
+        flushSettings();
+        return true;
+      }
+    }
+  }
+  _connectDeadline = 0;
+
+  return startConfigPortal(apName, apPassword);
+}
+
+#if WM_FEATURE_STA_API
+void AsyncWiFiManager::staModeSetup()
+{
+  setupApiCalls();
+  return;
+}
+
+void AsyncWiFiManager::setupApiCalls()
+{
+  startLogSink();
+  loadSettings();
+  setupRoutes(WM_MODE_STA);
+#if !defined(ESP8266)
+  startPortalTask();
+#endif
+}
+#endif
+
+// Pages served both behind the captive portal and as api calls on the
+// station's network, the mode passed to the handler covers the differences
+const AsyncWiFiManager::Route AsyncWiFiManager::ROUTES[] = {
+    {"/wifi", HTTP_ANY, &AsyncWiFiManager::handleRoot},
+    {"/api/v2/wifi/scan", HTTP_ANY, &AsyncWiFiManager::handleWifi},
+    {"/api/v2/wifi/save", HTTP_ANY, &AsyncWiFiManager::handleWifiSave},
+#if WM_FEATURE_INFO
+    {"/api/v2/wifi/info", HTTP_ANY, &AsyncWiFiManager::handleInfo},
+#endif
+    {"/api/v2/wifi/reset", HTTP_ANY, &AsyncWiFiManager::handleReset},
+#if WM_FEATURE_STAND_ALONE
+    {"/api/v2/wifi/stand_alone", HTTP_ANY, &AsyncWiFiManager::handleStandAlone},
+    {"/api/v2/wifi/stand_alone_yes", HTTP_GET, &AsyncWiFiManager::handleStandAloneYes},
+    {"/api/v2/wifi/stand_alone_no", HTTP_GET, &AsyncWiFiManager::handleStandAloneNo},
+#endif
+#ifdef USE_WM_METRICS
+    {"/api/v2/wifi/metrics", HTTP_ANY, &AsyncWiFiManager::handleMetrics},
+#endif
+};
+
+void AsyncWiFiManager::setupRoutes(AsyncWiFiManagerPortalMode mode)
+{
+  static_assert(sizeof(ROUTES) / sizeof(ROUTES[0]) <= WIFI_MANAGER_MAX_ROUTES, "every route needs an in-flight count");
+  for (size_t i = 0; i < sizeof(ROUTES) / sizeof(ROUTES[0]); i++)
+  {
+    AsyncCallbackWebHandler &handler = route(ROUTES[i].uri, ROUTES[i].method,
+                                             admit(i, std::bind(ROUTES[i].handler, this, std::placeholders::_1, mode)));
+    if (mode == WM_MODE_AP)
+    {
+      // the portal only answers on its own network
+      handler.setFilter(ON_AP_FILTER);
+    }
+  }
+  setupAssets(mode == WM_MODE_AP);
+#if WM_FEATURE_STA_API
+  setupScanEvent();
+#endif
+  setupEvents(mode);
+}
+
+void AsyncWiFiManager::setupAssets(boolean apOnly)
+{
+  for (size_t i = 0; i < sizeof(WM_ASSETS) / sizeof(WM_ASSETS[0]); i++)
+  {
+    const AsyncWiFiManagerAsset *asset = &WM_ASSETS[i];
+    AsyncCallbackWebHandler &handler = route(asset->path, HTTP_GET,
+                                             std::bind(&AsyncWiFiManager::handleAsset, this, std::placeholders::_1, asset));
+    if (apOnly)
+    {
+      handler.setFilter(ON_AP_FILTER);
+    }
+  }
+}
+
+// connect states as the events stream names them
+static const char *const WM_CONNECT_STATE_NAMES[] = {
+    "idle", "connecting", "associated", "connected", "failed", "timeout", "lost"};
+
+void AsyncWiFiManager::setupEvents(AsyncWiFiManagerPortalMode mode)
+{
+  if (_events == NULL)
+  {
+    _events = new AsyncEventSource("/api/v2/wifi/events");
+    // a new client gets the whole list and the current state, the loop only
+    // sends what changed after that
+    _events->onConnect([this](AsyncEventSourceClient *client)
+    {
+      String message;
+      StringPrint out(message);
+      {
+        AsyncWiFiManagerScanSnapshot snapshot(&_scanPool);
+        if (snapshot.published())
+        {
+          AsyncWiFiManagerJsonWriter json(out);
+          renderNetworksEvent(json, snapshot);
+          client->send(message.c_str(), "networks");
+        }
+      }
+      message = String();
+      AsyncWiFiManagerJsonWriter json(out);
+      renderStateEvent(json);
+      client->send(message.c_str(), "state");
+    });
+    server->addHandler(_events);
+  }
+  // one stream for both modes, the mode set up last decides who may listen
+  _events->setFilter(mode == WM_MODE_AP ? ON_AP_FILTER : ArRequestFilterFunction());
+}
+
+// called from the loop, so the stream is only ever written from one task
+void AsyncWiFiManager::sendEvents()
+{
+  if (_events == NULL)
+  {
+    return;
+  }
+  sendScanEvent();
+  sendStateEvent();
+}
+
+// networks are told apart by SSID, by SSID and BSSID while duplicates are kept
+uint32_t AsyncWiFiManager::networkId(const WiFiResult &result)
+{
+  uint32_t hash = stringHash(result.SSID);
+  if (!_removeDuplicateAPs)
+  {
+    for (size_t i = 0; i < sizeof(result.BSSID); i++)
+    {
+      hash = (hash ^ result.BSSID[i]) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+// diff a newly published scan against what the clients were told last
+void AsyncWiFiManager::sendScanEvent()
+{
+  if (_events->count() == 0)
+  {
+    _seenSynced = false; // the seen list goes stale, nobody is told
+    return;
+  }
+  AsyncWiFiManagerScanSnapshot snapshot(&_scanPool);
+  if (!snapshot.published() || (_seenSynced && snapshot.publishedAt() == _seenScanAt))
+  {
+    return;
+  }
+  _seenScanAt = snapshot.publishedAt();
+
+  const WiFiResult *results = snapshot.records();
+  wifi_ssid_count_t count = snapshot.count();
+  if (!_seenSynced)
+  {
+    // the first clients since the stream went quiet may hold an older list
+    // than this one, send them this one whole and diff against it from now on
+    _seenSynced = true;
+    for (wifi_ssid_count_t i = 0; i < count; i++)
+    {
+      _seen[i].id = networkId(results[i]);
+      _seen[i].quality = getRSSIasQuality(results[i].RSSI);
+    }
+    _seenCount = count;
+    String message;
+    StringPrint out(message);
+    AsyncWiFiManagerJsonWriter json(out);
+    renderNetworksEvent(json, snapshot);
+    _events->send(message.c_str(), "networks");
+    return;
+  }
+
+  uint32_t ids[WIFI_MANAGER_MAX_SCAN_RESULTS];
+  int16_t previous[WIFI_MANAGER_MAX_SCAN_RESULTS]; // index into _seen, -1 if new
+  boolean kept[WIFI_MANAGER_MAX_SCAN_RESULTS] = {false};
+  for (wifi_ssid_count_t i = 0; i < count; i++)
+  {
+    ids[i] = networkId(results[i]);
+    previous[i] = -1;
+    for (wifi_ssid_count_t j = 0; j < _seenCount; j++)
+    {
+      if (_seen[j].id == ids[i])
+      {
+        previous[i] = j;
+        kept[j] = true;
+        break;
+      }
+    }
+  }
+
+  boolean changed = false;
+  String message;
+  StringPrint out(message);
+  AsyncWiFiManagerJsonWriter json(out);
+  json.beginObject();
+  json.key("added");
+  json.beginArray();
+  for (wifi_ssid_count_t i = 0; i < count; i++)
+  {
+    if (previous[i] < 0)
+    {
+      changed = true;
+      renderNetworkEvent(json, results[i]);
+    }
+  }
+  json.endArray();
+  json.key("removed");
+  json.beginArray();
+  for (wifi_ssid_count_t j = 0; j < _seenCount; j++)
+  {
+    if (!kept[j])
+    {
+      changed = true;
+      json.value((unsigned long)_seen[j].id);
+    }
+  }
+  json.endArray();
+  json.key("changed");
+  json.beginArray();
+  AsyncWiFiManagerSeenNetwork seen[WIFI_MANAGER_MAX_SCAN_RESULTS];
+  for (wifi_ssid_count_t i = 0; i < count; i++)
+  {
+    uint8_t quality = getRSSIasQuality(results[i].RSSI);
+    seen[i].id = ids[i];
+    seen[i].quality = quality;
+    if (previous[i] < 0)
+    {
+      continue;
+    }
+    uint8_t told = _seen[previous[i]].quality;
+    if (abs((int)quality - (int)told) < WIFI_MANAGER_EVENTS_QUALITY_STEP)
+    {
+      // small moves add up until they are worth an event
+      seen[i].quality = told;
+      continue;
+    }
+    changed = true;
+    json.beginObject();
+    json.key("id");
+    json.value((unsigned long)ids[i]);
+    json.key("quality");
+    json.value((unsigned int)quality);
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+
+  memcpy(_seen, seen, count * sizeof(seen[0]));
+  _seenCount = count;
+  if (changed)
+  {
+    _events->send(message.c_str(), "scan");
+  }
+}
+
+void AsyncWiFiManager::sendStateEvent()
+{
+  uint8_t state = _connectState;
+  if (state == _sentState)
+  {
+    return;
+  }
+  _sentState = state;
+  if (_events->count() == 0)
   {
-    DEBUG_WM(F("scanNetworks returned: WIFI_SCAN_RUNNING!"));
+    return;
   }
-  else if (n < 0)
+  String message;
+  StringPrint out(message);
+  AsyncWiFiManagerJsonWriter json(out);
+  renderStateEvent(json);
+  _events->send(message.c_str(), "state");
+}
+
+void AsyncWiFiManager::renderNetworksEvent(AsyncWiFiManagerJsonWriter &json, AsyncWiFiManagerScanSnapshot &snapshot)
+{
+  const WiFiResult *results = snapshot.records();
+  json.beginArray();
+  for (int i = 0; i < snapshot.count(); i++)
   {
-    DEBUG_WM(F("scanNetworks failed with unknown error code!"));
+    renderNetworkEvent(json, results[i]);
   }
-  else if (n == 0)
+  json.endArray();
+}
+
+void AsyncWiFiManager::renderNetworkEvent(AsyncWiFiManagerJsonWriter &json, const WiFiResult &result)
+{
+#if defined(ESP8266)
+  boolean secure = result.encryptionType != ENC_TYPE_NONE;
+#else
+  boolean secure = result.encryptionType != WIFI_AUTH_OPEN;
+#endif
+  json.beginObject();
+  json.key("id");
+  json.value((unsigned long)networkId(result));
+  json.key("ssid");
+  json.value(result.SSID);
+  json.key("quality");
+  json.value(getRSSIasQuality(result.RSSI));
+  json.key("secure");
+  json.value(secure);
+  json.endObject();
+}
+
+void AsyncWiFiManager::renderStateEvent(AsyncWiFiManagerJsonWriter &json)
+{
+  uint8_t state = _connectState;
+  AsyncWiFiManagerLiveInfo live = liveInfo();
+  json.beginObject();
+  json.key("state");
+  json.value(WM_CONNECT_STATE_NAMES[state]);
+  json.key("pending");
+  json.value(connectPending(state));
+  json.key("ssid");
+  json.value(live.ssid);
+  json.key("ip");
+  json.value(live.ip);
+  json.endObject();
+}
+
+AsyncWiFiManagerAdmission::AsyncWiFiManagerAdmission(std::atomic<uint8_t> *inFlight) : _inFlight(inFlight)
+{
+  (*_inFlight)++;
+}
+
+AsyncWiFiManagerAdmission::~AsyncWiFiManagerAdmission()
+{
+  (*_inFlight)--;
+}
+
+#if !defined(ESP8266)
+// the esp_timer is created on first use, global managers are constructed
+// before the timer service is guaranteed to be up
+AsyncWiFiManagerTimer::AsyncWiFiManagerTimer(void (*callback)(void *), void *arg) : _callback(callback), _arg(arg)
+{
+}
+
+AsyncWiFiManagerTimer::~AsyncWiFiManagerTimer()
+{
+  esp_timer_handle_t timer = _timer.exchange(NULL);
+  if (timer != NULL)
   {
-    DEBUG_WM(F("No networks found"));
-    // page += F("No networks found. Refresh to scan again.");
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
   }
-  else
+}
+
+void AsyncWiFiManagerTimer::once(uint32_t ms)
+{
+  esp_timer_handle_t timer = _timer;
+  if (timer == NULL)
   {
-    DEBUG_WM(F("Scan done"));
+    esp_timer_create_args_t args = {};
+    args.callback = _callback;
+    args.arg = _arg;
+    args.name = "wm";
+    if (esp_timer_create(&args, &timer) != ESP_OK)
+    {
+      return;
+    }
+    esp_timer_handle_t expected = NULL;
+    if (!_timer.compare_exchange_strong(expected, timer))
+    {
+      esp_timer_delete(timer); // another task was first
+      timer = expected;
+    }
+  }
+  esp_timer_stop(timer);
+  esp_timer_start_once(timer, (uint64_t)ms * 1000);
+}
+
+void AsyncWiFiManagerTimer::stop()
+{
+  esp_timer_handle_t timer = _timer;
+  if (timer != NULL)
+  {
+    esp_timer_stop(timer);
+  }
+}
+#endif
+
+void AsyncWiFiManager::setAdmission(uint8_t maxInFlight, uint32_t minFreeHeap)
+{
+  _maxInFlight = maxInFlight;
+  _minFreeHeap = minFreeHeap;
+}
+
+// Both checks are a compare before any page is rendered, so a flood of
+// requests costs one small 503 each instead of a page each. The scan routes
+// need no extra care: in the portal they only ask the loop for a scan, as api
+// calls startScan() joins a scan that is already running
+ArRequestHandlerFunction AsyncWiFiManager::admit(uint8_t route, ArRequestHandlerFunction fn)
+{
+  return [this, route, fn](AsyncWebServerRequest *request)
+  {
+    if ((_minFreeHeap != 0 && ESP.getFreeHeap() < _minFreeHeap) ||
+        (_maxInFlight != 0 && _inFlight[route] >= _maxInFlight))
+    {
+      sendBusy(request);
+      return;
+    }
+    _currentAdmission.reset(new AsyncWiFiManagerAdmission(&_inFlight[route]));
+    fn(request);
+    _currentAdmission.reset();
+  };
+}
+
+void AsyncWiFiManager::sendBusy(AsyncWebServerRequest *request)
+{
+  WM_LOGI(F("Busy, turned away"));
+  WM_LOGI(request->url());
+#ifdef USE_WM_METRICS
+  if (_currentMetrics != NULL)
+  {
+    _currentMetrics->rejected++;
+  }
+#endif
+  AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Busy");
+  response->addHeader("Retry-After", WIFI_MANAGER_RETRY_AFTER);
+  request->send(response);
+}
+
+AsyncCallbackWebHandler &AsyncWiFiManager::route(const char *uri, ArRequestHandlerFunction fn)
+{
+  return server->on(uri, instrument(uri, fn));
+}
+
+AsyncCallbackWebHandler &AsyncWiFiManager::route(const char *uri, WebRequestMethodComposite method,
+                                                 ArRequestHandlerFunction fn)
+{
+  return server->on(uri, method, instrument(uri, fn));
+}
+
+#ifdef USE_WM_METRICS
+// upper bounds of the latency buckets in us, the last bucket takes the rest
+static const uint32_t WM_LATENCY_BOUNDS[WIFI_MANAGER_LATENCY_BUCKETS - 1] = {
+    100, 500, 1000, 5000, 10000, 50000, 100000};
+
+uint32_t AsyncWiFiManager::largestFreeBlock()
+{
+#if defined(ESP8266)
+  return ESP.getMaxFreeBlockSize();
+#else
+  return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#endif
+}
+
+AsyncWiFiManagerRouteMetrics *AsyncWiFiManager::routeMetrics(const char *uri)
+{
+  for (uint8_t i = 0; i < _metricsCount; i++)
+  {
+    if (strcmp(_metrics[i].route, uri) == 0)
+    {
+      return &_metrics[i];
+    }
+  }
+  if (_metricsCount >= WIFI_MANAGER_MAX_ROUTES)
+  {
+    WM_LOGE(F("No room for the metrics of route"));
+    WM_LOGE(uri);
+    return NULL;
   }
+  AsyncWiFiManagerRouteMetrics *metrics = &_metrics[_metricsCount++];
+  memset(metrics, 0, sizeof(AsyncWiFiManagerRouteMetrics));
+  metrics->route = uri;
+  metrics->minLargestBlock = UINT32_MAX;
+  return metrics;
+}
+#endif
 
-  if (n > 0)
+ArRequestHandlerFunction AsyncWiFiManager::instrument(const char *uri, ArRequestHandlerFunction fn)
+{
+#ifdef USE_WM_METRICS
+  // both portal modes register the same uris, they share one record
+  AsyncWiFiManagerRouteMetrics *metrics = routeMetrics(uri);
+  if (metrics == NULL)
+  {
+    return fn;
+  }
+  return [this, metrics, fn](AsyncWebServerRequest *request)
   {
-    // WE SHOULD MOVE THIS IN PLACE ATOMICALLY
-    if (wifiSSIDs)
+    uint32_t heapBefore = ESP.getFreeHeap();
+    _currentMetrics = metrics;
+    unsigned long start = micros();
+    fn(request);
+    unsigned long elapsed = micros() - start;
+    _currentMetrics = NULL;
+
+    uint8_t bucket = 0;
+    while (bucket < WIFI_MANAGER_LATENCY_BUCKETS - 1 && elapsed > WM_LATENCY_BOUNDS[bucket])
+    {
+      bucket++;
+    }
+    metrics->requests++;
+    metrics->latency[bucket]++;
+    metrics->latencySum += elapsed;
+    metrics->heapBefore = heapBefore;
+    metrics->heapAfter = ESP.getFreeHeap();
+    metrics->largestBlockAfter = largestFreeBlock();
+    if (metrics->largestBlockAfter < metrics->minLargestBlock)
     {
-      delete[] wifiSSIDs;
+      metrics->minLargestBlock = metrics->largestBlockAfter;
     }
-    wifiSSIDs = new WiFiResult[n];
-    wifiSSIDCount = n;
+  };
+#else
+  (void)uri;
+  return fn;
+#endif
+}
+
+String AsyncWiFiManager::networkListAsString()
+{
+  String pager;
+  StringPrint out(pager);
+  AsyncWiFiManagerScanSnapshot snapshot(&_scanPool);
+  renderNetworkList(out, snapshot);
+  return pager;
+}
+
+void AsyncWiFiManager::renderNetworkList(Print &out, AsyncWiFiManagerScanSnapshot &snapshot)
+{
+  // display networks in page, the snapshot is already sorted and filtered
+  const WiFiResult *results = snapshot.records();
+  for (int i = 0; i < snapshot.count(); i++)
+  {
+    char rssiQ[4];
+    snprintf(rssiQ, sizeof(rssiQ), "%u", getRSSIasQuality(results[i].RSSI));
+#if defined(ESP8266)
+    boolean secure = results[i].encryptionType != ENC_TYPE_NONE;
+#else
+    boolean secure = results[i].encryptionType != WIFI_AUTH_OPEN;
+#endif
+    const char *values[] = {results[i].SSID, rssiQ, secure ? "l" : ""};
+    itemTemplate.render(out, values);
+  }
+}
+
+String AsyncWiFiManager::scanModal()
+{
+  shouldscan = true;
+  scan();
+  String pager = networkListAsString();
+  return pager;
+}
+
+void AsyncWiFiManager::scan(boolean async)
+{
+  if (!shouldscan)
+  {
+    return;
+  }
+  if (async)
+  {
+    // picked up by the scan scheduler on the next loop
+    requestScan();
+    return;
+  }
+  DEBUG_WM(F("About to scan()"));
+  if (wifiSSIDscan)
+  {
+    wifi_ssid_count_t n = WiFi.scanNetworks(false);
+    copySSIDInfo(n);
+  }
+}
+
+void AsyncWiFiManager::requestScan()
+{
+  _scanRequested = true;
+  wake();
+}
+
+// Page views ask for a scan on every hit. In the modal portal that cuts the
+// station off for each one, so only a list older than the cache TTL gets one
+void AsyncWiFiManager::requestPageScan()
+{
+  AsyncWiFiManagerScanSnapshot last(&_scanPool);
+  if (!last.published() || millis() - last.publishedAt() >= _scanCacheTTL)
+  {
+    requestScan();
+  }
+}
+
+void AsyncWiFiManager::setScanInterval(unsigned long seconds, unsigned long idleSeconds)
+{
+  _scanInterval = seconds * 1000;
+  _scanIdleInterval = std::max(idleSeconds * 1000, _scanInterval);
+  _scanBackoff = _scanInterval;
+}
+
+// the modeless portal shares the station's radio with the application and
+// keeps its longer interval unless the sketch set one
+unsigned long AsyncWiFiManager::scanInterval()
+{
+  if (_scanInterval != 0)
+  {
+    return _scanInterval;
+  }
+  return _modeless ? WIFI_MANAGER_MODELESS_SCAN_INTERVAL : WIFI_MANAGER_SCAN_INTERVAL;
+}
 
-    if (n > 0)
+// Non-blocking scan scheduler shared by the modal and modeless portal. Starts
+// an async scan when one is requested or due and harvests it once the driver
+// reports it complete. While no station is attached to the soft AP the
+// interval doubles after every scan up to the idle interval. Returns true when
+// a scan finished, successful or not.
+boolean AsyncWiFiManager::scheduleScan(boolean stopConnecting)
+{
+  if (_scanRunning)
+  {
+    if (!finishScan())
     {
-      shouldscan = false;
+      return false;
     }
-    for (wifi_ssid_count_t i = 0; i < n; i++)
+    if (WiFi.softAPgetStationNum() == 0)
     {
-      wifiSSIDs[i].duplicate = false;
+      _scanBackoff = std::min(_scanBackoff * 2, std::max(_scanIdleInterval, scanInterval()));
+    }
+    return true;
+  }
+
+  if (WiFi.softAPgetStationNum() > 0)
+  {
+    _scanBackoff = scanInterval();
+  }
+  else if (_powerSave && !_scanRequested)
+  {
+    return false; // nobody to show a list to, reconnectDue() keeps retrying
+  }
+  if (!_scanRequested && _lastScan != 0 && millis() - _lastScan < _scanBackoff)
+  {
+    return false;
+  }
+  if (stopConnecting && connectPending(_connectState))
+  {
+    return false; // a scan would cut the attempt short, wait for it
+  }
+  _scanRequested = false;
 
+  if (stopConnecting && WiFi.status() != WL_CONNECTED)
+  {
 #if defined(ESP8266)
-      WiFi.getNetworkInfo(i,
-                          wifiSSIDs[i].SSID,
-                          wifiSSIDs[i].encryptionType,
-                          wifiSSIDs[i].RSSI,
-                          wifiSSIDs[i].BSSID,
-                          wifiSSIDs[i].channel,
-                          wifiSSIDs[i].isHidden);
+    // we might still be connecting, so that has to stop for scanning
+    ETS_UART_INTR_DISABLE();
+    wifi_station_disconnect();
+    ETS_UART_INTR_ENABLE();
 #else
-      WiFi.getNetworkInfo(i,
-                          wifiSSIDs[i].SSID,
-                          wifiSSIDs[i].encryptionType,
-                          wifiSSIDs[i].RSSI,
-                          wifiSSIDs[i].BSSID,
-                          wifiSSIDs[i].channel);
+    WiFi.disconnect(false);
 #endif
+  }
+  startScan();
+  return false;
+}
+
+// In power save no scans run while the soft AP is empty, so the modal portal
+// takes its reconnect attempts from here instead, once per idle interval
+boolean AsyncWiFiManager::reconnectDue()
+{
+  if (!_powerSave || _scanRunning || WiFi.softAPgetStationNum() > 0)
+  {
+    return false;
+  }
+  if (_lastReconnect != 0 && millis() - _lastReconnect < _scanIdleInterval)
+  {
+    return false;
+  }
+  _lastReconnect = millis();
+  return true;
+}
+
+// start an async scan unless one is already running
+boolean AsyncWiFiManager::startScan()
+{
+  // the loop and the api handlers may ask at the same time, they all share
+  // the one scan that gets started
+  if (_scanRunning || _scanStarting.exchange(true))
+  {
+    return true;
+  }
+  if (_scanRunning)
+  {
+    _scanStarting = false;
+    return true;
+  }
+  DEBUG_WM(F("About to scan()"));
+  if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED)
+  {
+    WM_LOGE(F("Could not start scan"));
+    _lastScan = millis();
+    _scanStarting = false;
+    return false;
+  }
+  _scanStarted = millis();
+  _scanRunning = true;
+  _scanStarting = false;
+  return true;
+}
+
+// Harvest a running scan into the pool once the driver is done with it. Called
+// from the loop, from the scan done event and from handlers, whoever gets there
+// first publishes the result. Returns true if this call finished the scan.
+boolean AsyncWiFiManager::finishScan()
+{
+  if (!_scanRunning)
+  {
+    return false;
+  }
+  wifi_ssid_count_t n = WiFi.scanComplete();
+  if (n == WIFI_SCAN_RUNNING)
+  {
+    if (millis() - _scanStarted < WIFI_MANAGER_SCAN_TIMEOUT)
+    {
+      return false;
     }
+    DEBUG_WM(F("Scan timed out"));
+    n = WIFI_SCAN_FAILED;
+  }
+  if (!_scanRunning.exchange(false))
+  {
+    return false; // somebody else harvested it
+  }
+  _lastScan = millis();
+  if (n >= 0)
+  {
+    copySSIDInfo(n);
+  }
+  else
+  {
+    reportScan(n);
+  }
+  WiFi.scanDelete();
+  return true;
+}
+
+#if WM_FEATURE_STA_API
+// without a portal loop (STA mode) nobody polls the scan, let the driver's
+// scan done event publish it
+void AsyncWiFiManager::setupScanEvent()
+{
+#if !defined(ESP8266)
+  if (_scanEventId == 0)
+  {
+    _scanEventId = WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info)
+                                { finishScan(); },
+                                SYSTEM_EVENT_SCAN_DONE);
+  }
+#endif
+}
+#endif
+
+void AsyncWiFiManager::setPowerSave(boolean enable)
+{
+  _powerSave = enable;
+#if !defined(ESP8266)
+  if (_stationEventId != 0)
+  {
+    WiFi.removeEvent(_stationEventId);
+    _stationEventId = 0;
+  }
+  if (enable)
+  {
+    // a joining station ends the long sleep right away
+    _stationEventId = WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info)
+                                   { wake(); },
+                                   SYSTEM_EVENT_AP_STACONNECTED);
+  }
+#endif
+}
+
+void AsyncWiFiManager::updateStations()
+{
+  uint8_t stations = WiFi.softAPgetStationNum();
+  if (_powerSave && stations > 0 && _stations == 0)
+  {
+    requestScan(); // the list is as old as the pause
+  }
+  _stations = stations;
+}
 
-    // RSSI SORT
+void AsyncWiFiManager::setChannelPlanning(boolean enable)
+{
+  _channelPlanning = enable;
+}
+
+// channels that do not overlap in 2.4 GHz
+static const uint8_t WM_PLAN_CHANNELS[] = {1, 6, 11};
+
+uint8_t AsyncWiFiManager::planChannel()
+{
+  boolean fresh;
+  {
+    AsyncWiFiManagerScanSnapshot snapshot(&_scanPool);
+    fresh = snapshot.published() && millis() - snapshot.publishedAt() < _scanCacheTTL;
+  }
+  if (!fresh && !_scanRunning)
+  {
+    DEBUG_WM(F("Scanning to plan the AP channel"));
+    shouldscan = true; // the last harvest cleared it, scan() would return
+    scan(false);
+  }
+  AsyncWiFiManagerScanSnapshot snapshot(&_scanPool);
+  const WiFiResult *results = snapshot.records();
 
-    // old sort
-    for (int i = 0; i < n; i++)
+  // once the station is up the AP has to move to its channel anyway, so
+  // start there and spare the clients the hop
+  if (_tryConnectDuringConfigPortal)
+  {
+    char target[sizeof(_networkStore.networks[0].ssid)] = "";
+    loadSettings();
+    WM_SETTINGS_LOCK();
+    if (_networkStore.count > 0)
+    {
+      memcpy(target, _networkStore.networks[0].ssid, sizeof(target));
+    }
+    WM_SETTINGS_UNLOCK();
+    for (int r = 0; target[0] != '\0' && r < snapshot.count(); r++)
     {
-      for (int j = i + 1; j < n; j++)
+      if (strcmp(results[r].SSID, target) == 0)
       {
-        if (wifiSSIDs[j].RSSI > wifiSSIDs[i].RSSI)
-        {
-          std::swap(wifiSSIDs[i], wifiSSIDs[j]);
-        }
+        DEBUG_WM(F("AP channel of the reconnect target"));
+        DEBUG_WM(results[r].channel);
+        return results[r].channel;
       }
     }
+  }
 
-    // remove duplicates ( must be RSSI sorted )
-    if (_removeDuplicateAPs)
+  // every AP loads the planned channels it overlaps, more the stronger it
+  // is and the closer its channel
+  uint32_t load[sizeof(WM_PLAN_CHANNELS)] = {0};
+  for (int r = 0; r < snapshot.count(); r++)
+  {
+    uint32_t weight = std::max(results[r].RSSI + 100, 1);
+    for (uint8_t p = 0; p < sizeof(WM_PLAN_CHANNELS); p++)
     {
-      String cssid;
-      for (int i = 0; i < n; i++)
+      int distance = abs((int)results[r].channel - WM_PLAN_CHANNELS[p]);
+      if (distance < 5)
       {
-        if (wifiSSIDs[i].duplicate == true)
-        {
-          continue;
-        }
-        cssid = wifiSSIDs[i].SSID;
-        for (int j = i + 1; j < n; j++)
-        {
-          if (cssid == wifiSSIDs[j].SSID)
-          {
-            DEBUG_WM("DUP AP: " + wifiSSIDs[j].SSID);
-            wifiSSIDs[j].duplicate = true; // set dup aps to NULL
-          }
-        }
+        load[p] += weight * (5 - distance);
       }
     }
   }
+  uint8_t best = 0;
+  for (uint8_t p = 1; p < sizeof(WM_PLAN_CHANNELS); p++)
+  {
+    if (load[p] < load[best])
+    {
+      best = p;
+    }
+  }
+  DEBUG_WM(F("Planned AP channel"));
+  DEBUG_WM(WM_PLAN_CHANNELS[best]);
+  return WM_PLAN_CHANNELS[best];
+}
+
+void AsyncWiFiManager::setScanCacheTTL(unsigned long seconds)
+{
+  _scanCacheTTL = seconds * 1000;
+}
+
+// age of the snapshot in the scan header, the page's script picks up the
+// running scan from /api/v2/wifi/events
+AsyncWebServerResponse *AsyncWiFiManager::beginScanResponse(AsyncWebServerRequest *request,
+                                                            AsyncWiFiManagerScanSnapshot &snapshot,
+                                                            AsyncWiFiManagerRenderer render,
+                                                            boolean json)
+{
+  AsyncWebServerResponse *response = beginPageResponse(request, render, json ? "application/json" : "text/html");
+  if (snapshot.published())
+  {
+    response->addHeader("X-Scan-Age", String((millis() - snapshot.publishedAt()) / 1000));
+  }
+  return response;
 }
 
-void AsyncWiFiManager::copySSIDInfoSTA(wifi_ssid_count_t n, WiFiResult *wifiSSIDs2)
+void AsyncWiFiManager::reportScan(wifi_ssid_count_t n)
 {
   if (n == WIFI_SCAN_FAILED)
   {
-    DEBUG_WM(F("scanNetworks returned: WIFI_SCAN_FAILED!"));
+    WM_LOGE(F("scanNetworks returned: WIFI_SCAN_FAILED!"));
   }
   else if (n == WIFI_SCAN_RUNNING)
   {
@@ -526,7 +2016,7 @@ void AsyncWiFiManager::copySSIDInfoSTA(wifi_ssid_count_t n, WiFiResult *wifiSSID
   }
   else if (n < 0)
   {
-    DEBUG_WM(F("scanNetworks failed with unknown error code!"));
+    WM_LOGE(F("scanNetworks failed with unknown error code!"));
   }
   else if (n == 0)
   {
@@ -537,50 +2027,197 @@ void AsyncWiFiManager::copySSIDInfoSTA(wifi_ssid_count_t n, WiFiResult *wifiSSID
   {
     DEBUG_WM(F("Scan done"));
   }
+}
 
-  if (n > 0)
+// networks as the driver found them
+class WiFiScanSource
+{
+public:
+  int8_t rssi(uint8_t i)
   {
-    if (n > 10)
-    {
-      n = 10;
-    }
-    // WE SHOULD MOVE THIS IN PLACE ATOMICALLY
-    if (wifiSSIDs2)
-    {
-      delete[] wifiSSIDs2;
-    }
-    wifiSSIDs2 = new WiFiResult[n];
+    return WiFi.RSSI(i);
+  }
 
-    for (wifi_ssid_count_t i = 0; i < n; i++)
-    {
-      wifiSSIDs2[i].duplicate = false;
+  void read(uint8_t i, String &ssid, uint8_t &encryptionType, int32_t &RSSI,
+            uint8_t *&BSSID, int32_t &channel, bool &isHidden)
+  {
+#if defined(ESP8266)
+    WiFi.getNetworkInfo(i, ssid, encryptionType, RSSI, BSSID, channel, isHidden);
+#else
+    WiFi.getNetworkInfo(i, ssid, encryptionType, RSSI, BSSID, channel);
+#endif
+  }
+};
+
+// networks from records, for synthetic scans
+class RecordScanSource
+{
+public:
+  RecordScanSource(const WiFiResult *records) : _records(records) {}
+
+  int8_t rssi(uint8_t i)
+  {
+    return _records[i].RSSI;
+  }
+
+  void read(uint8_t i, String &ssid, uint8_t &encryptionType, int32_t &RSSI,
+            uint8_t *&BSSID, int32_t &channel, bool &isHidden)
+  {
+    const WiFiResult &record = _records[i];
+    ssid = record.SSID;
+    encryptionType = record.encryptionType;
+    RSSI = record.RSSI;
+    BSSID = (uint8_t *)record.BSSID;
+    channel = record.channel;
+    isHidden = record.isHidden;
+  }
+
+private:
+  const WiFiResult *_records;
+};
+
+// Shared scan pipeline: sorts an index array of the n networks the driver
+// found by RSSI, then copies them best first into results, skipping weak ones
+// and duplicates (through a hash table of the kept SSIDs) on the way. Only
+// networks that are kept are read out in full. Returns how many were kept.
+template <typename Source>
+wifi_ssid_count_t AsyncWiFiManager::indexScanResults(Source &source,
+                                                     wifi_ssid_count_t n,
+                                                     WiFiResult *results,
+                                                     wifi_ssid_count_t limit,
+                                                     boolean removeDuplicates,
+                                                     boolean filterQuality)
+{
+  n = std::min(n, (wifi_ssid_count_t)WIFI_MANAGER_MAX_SCAN_INDEX);
+  limit = std::min(limit, (wifi_ssid_count_t)WIFI_MANAGER_MAX_SCAN_RESULTS);
+
+  uint8_t order[WIFI_MANAGER_MAX_SCAN_INDEX];
+  int8_t rssi[WIFI_MANAGER_MAX_SCAN_INDEX];
+  for (wifi_ssid_count_t i = 0; i < n; i++)
+  {
+    order[i] = i;
+    rssi[i] = source.rssi(i);
+  }
+  std::sort(order, order + n, [&rssi](uint8_t a, uint8_t b)
+  {
+    // ties keep scan order so the result does not depend on the sort
+    return rssi[a] > rssi[b] || (rssi[a] == rssi[b] && a < b);
+  });
+
+#if WM_FEATURE_REMOVE_DUPLICATES
+  // open addressing table of kept SSIDs, slot value is index into results + 1
+  const size_t tableSize = 2 * WIFI_MANAGER_MAX_SCAN_RESULTS;
+  uint8_t table[tableSize] = {0};
+  uint32_t hashes[WIFI_MANAGER_MAX_SCAN_RESULTS];
+#else
+  (void)removeDuplicates;
+#endif
+
+  // reused for every network, so reading the SSIDs allocates once
+  String ssid;
+  uint8_t encryptionType;
+  int32_t RSSI;
+  uint8_t *BSSID;
+  int32_t channel;
+  bool isHidden = false;
 
-      WiFi.getNetworkInfo(i,
-                          wifiSSIDs2[i].SSID,
-                          wifiSSIDs2[i].encryptionType,
-                          wifiSSIDs2[i].RSSI,
-                          wifiSSIDs2[i].BSSID,
-                          wifiSSIDs2[i].channel);
+  wifi_ssid_count_t kept = 0;
+  for (wifi_ssid_count_t i = 0; i < n && kept < limit; i++)
+  {
+    if (filterQuality && _minimumQuality != 0 && getRSSIasQuality(rssi[order[i]]) <= _minimumQuality)
+    {
+      WM_LOGV(F("Skipping due to quality"));
+      continue;
     }
 
-    // RSSI SORT
+    source.read(order[i], ssid, encryptionType, RSSI, BSSID, channel, isHidden);
 
-    // old sort
-    for (int i = 0; i < n; i++)
+#if WM_FEATURE_REMOVE_DUPLICATES
+    if (removeDuplicates)
     {
-      for (int j = i + 1; j < n; j++)
+      uint32_t hash = stringHash(ssid.c_str());
+      size_t slot = hash % tableSize;
+      boolean duplicate = false;
+      while (table[slot] != 0)
       {
-        if (wifiSSIDs2[j].RSSI > wifiSSIDs2[i].RSSI)
+        uint8_t other = table[slot] - 1;
+        if (hashes[other] == hash && strcmp(results[other].SSID, ssid.c_str()) == 0)
         {
-          std::swap(wifiSSIDs2[i], wifiSSIDs2[j]);
+          duplicate = true;
+          break;
         }
+        slot = (slot + 1) % tableSize;
       }
+      if (duplicate)
+      {
+        WM_LOGV("DUP AP: " + ssid);
+        continue;
+      }
+      hashes[kept] = hash;
+      table[slot] = kept + 1;
+    }
+#endif
+
+    WiFiResult &result = results[kept++];
+    strncpy(result.SSID, ssid.c_str(), sizeof(result.SSID) - 1);
+    result.SSID[sizeof(result.SSID) - 1] = 0;
+    if (BSSID != NULL)
+    {
+      memcpy(result.BSSID, BSSID, sizeof(result.BSSID));
+    }
+    else
+    {
+      memset(result.BSSID, 0, sizeof(result.BSSID));
     }
+    result.RSSI = RSSI;
+    result.channel = channel;
+    result.encryptionType = encryptionType;
+    result.isHidden = isHidden;
+  }
+  return kept;
+}
+
+// read the finished scan into the pool and publish it
+template <typename Source>
+void AsyncWiFiManager::harvestScan(Source &source,
+                                   wifi_ssid_count_t n,
+                                   wifi_ssid_count_t limit,
+                                   boolean removeDuplicates,
+                                   boolean filterQuality)
+{
+  reportScan(n);
+
+  if (n <= 0)
+  {
+    return;
   }
+  WiFiResult *results = _scanPool.beginWrite();
+  if (results == NULL)
+  {
+    // both buffers are being rendered, keep the current snapshot
+    DEBUG_WM(F("Scan results busy, dropping scan"));
+    return;
+  }
+  shouldscan = false;
+  _scanPool.publish(indexScanResults(source, n, results, limit, removeDuplicates, filterQuality));
+}
+
+void AsyncWiFiManager::copySSIDInfo(wifi_ssid_count_t n)
+{
+  WiFiScanSource source;
+  harvestScan(source, n, WIFI_MANAGER_MAX_SCAN_RESULTS, _removeDuplicateAPs, true);
+}
+
+void AsyncWiFiManager::copySSIDInfo(const WiFiResult *records, wifi_ssid_count_t n)
+{
+  RecordScanSource source(records);
+  harvestScan(source, n, WIFI_MANAGER_MAX_SCAN_RESULTS, _removeDuplicateAPs, true);
 }
 
 void AsyncWiFiManager::startConfigPortalModeless(char const *apName, char const *apPassword)
 {
+  startLogSink();
+  loadSettings();
   _modeless = true;
   _apName = apName;
   _apPassword = apPassword;
@@ -613,9 +2250,13 @@ void AsyncWiFiManager::startConfigPortalModeless(char const *apName, char const
     _apcallback(this);
   }
 
-  connect = false;
+  dropConnectJob();
   setupConfigPortal();
-  scannow = 0;
+  _lastScan = 0;
+  _scanBackoff = scanInterval();
+#if !defined(ESP8266)
+  startPortalTask();
+#endif
 }
 
 void AsyncWiFiManager::loop()
@@ -626,49 +2267,110 @@ void AsyncWiFiManager::loop()
 
 void AsyncWiFiManager::setInfo()
 {
-  pager = infoAsString();
-  wifiStatus = WiFi.status();
+#if WM_FEATURE_INFO
+  loadStaticInfo();
+#endif
+  refreshLiveInfo();
   needInfo = false;
 }
 
-String AsyncWiFiManager::setInfoSTA()
+#if WM_FEATURE_INFO
+void AsyncWiFiManager::loadStaticInfo()
+{
+  if (_staticInfoReady)
+  {
+    return;
+  }
+#if defined(ESP8266)
+  _staticInfo.chipId = ESP.getChipId();
+  _staticInfo.flashChipId = ESP.getFlashChipId();
+  _staticInfo.realFlashSize = ESP.getFlashChipRealSize();
+#else
+  formatESP32ChipID(_staticInfo.chipId);
+#endif
+  _staticInfo.flashSize = ESP.getFlashChipSize();
+  strncpy(_staticInfo.softAPMac, WiFi.softAPmacAddress().c_str(), sizeof(_staticInfo.softAPMac) - 1);
+  _staticInfo.softAPMac[sizeof(_staticInfo.softAPMac) - 1] = '\0';
+  strncpy(_staticInfo.mac, WiFi.macAddress().c_str(), sizeof(_staticInfo.mac) - 1);
+  _staticInfo.mac[sizeof(_staticInfo.mac) - 1] = '\0';
+  // the MACs read as zeros until WiFi is started, try again then
+  _staticInfoReady = WiFi.getMode() != WIFI_OFF;
+}
+#endif
+
+void AsyncWiFiManager::refreshLiveInfo()
+{
+  AsyncWiFiManagerLiveInfo live;
+  strncpy(live.ssid, WiFi.SSID().c_str(), sizeof(live.ssid) - 1);
+  live.ssid[sizeof(live.ssid) - 1] = '\0';
+  live.ip = WiFi.localIP();
+  live.softAPIP = WiFi.softAPIP();
+  live.status = WiFi.status();
+  live.rssi = live.status == WL_CONNECTED ? WiFi.RSSI() : 0;
+#if !defined(ESP8266)
+  portENTER_CRITICAL(&_infoLock);
+#endif
+  _liveInfo = live;
+#if !defined(ESP8266)
+  portEXIT_CRITICAL(&_infoLock);
+#endif
+}
+
+AsyncWiFiManagerLiveInfo AsyncWiFiManager::liveInfo()
 {
-  String pager2;
-  pager2 = infoAsString();
-  return pager2;
+#if !defined(ESP8266)
+  portENTER_CRITICAL(&_infoLock);
+#endif
+  AsyncWiFiManagerLiveInfo live = _liveInfo;
+#if !defined(ESP8266)
+  portEXIT_CRITICAL(&_infoLock);
+#endif
+  return live;
 }
 
 // anything that accesses WiFi, ESP or EEPROM goes here
 void AsyncWiFiManager::criticalLoop()
 {
-  if (_modeless)
+  if (!ownsLoop())
   {
-    if (scannow == 0 || millis() - scannow >= 60000)
-    {
-      scannow = millis();
-      scan(true);
-    }
+    return; // the portal task runs it
+  }
+  updateStations();
+  // settings changes go to NVS once they have settled
+  if (_settingsDirty != 0 && millis() - _settingsChanged >= WIFI_MANAGER_SETTINGS_FLUSH_DELAY)
+  {
+    flushSettings();
+  }
+  runPendingAction();
+  sendEvents();
 
-    wifi_ssid_count_t n = WiFi.scanComplete();
-    if (n >= 0)
-    {
-      copySSIDInfo(n);
-      WiFi.scanDelete();
-    }
+  if (_modeless)
+  {
+    scheduleScan(false);
 
-    if (connect)
+    AsyncWiFiManagerConnectJob job;
+    if (takeConnectJob(&job))
     {
-      connect = false;
-      //delay(2000);
+      applyConnectJob(job);
       DEBUG_WM(F("Connecting to new AP"));
 
       // using user-provided _ssid, _pass in place of system-stored ssid and pass
-      if (connectWifi(_ssid, _pass) != WL_CONNECTED)
+      beginConnect(_ssid, _pass);
+      _saveConnecting = true;
+    }
+
+    if (_saveConnecting)
+    {
+      AsyncWiFiManagerConnectState state = pollConnect();
+      if (connectPending(state))
       {
-        DEBUG_WM(F("Failed to connect"));
+        return;
       }
-      else
+      _saveConnecting = false;
+      setInfo();
+      if (state == WM_CONNECT_CONNECTED)
       {
+        storeFastReconnect();
         // connected
         // alanswx - should we have a config to decide if we should shut down AP?
         // WiFi.mode(WIFI_STA);
@@ -678,10 +2380,10 @@ void AsyncWiFiManager::criticalLoop()
           // TODO: check if any custom parameters actually exist, and check if they really changed maybe
           _savecallback();
         }
-
         return;
       }
 
+      WM_LOGI(F("Failed to connect"));
       if (_shouldBreakAfterConfig)
       {
         // flag set to exit after config after trying to connect
@@ -699,129 +2401,84 @@ void AsyncWiFiManager::criticalLoop()
 // anything that doesn't access WiFi, ESP or EEPROM can go here
 void AsyncWiFiManager::safeLoop()
 {
-#ifndef USE_EADNS
-  dnsServer->processNextRequest();
-#endif
+  if (!ownsLoop())
+  {
+    return;
+  }
+  processDNS();
 }
 
-boolean AsyncWiFiManager::startConfigPortal(char const *apName, char const *apPassword)
+// setup the DNS server redirecting all the domains to the apIP
+void AsyncWiFiManager::startDNS()
 {
-  // setup AP
-  WiFi.mode(WIFI_AP_STA);
-  DEBUG_WM(F("SET AP STA"));
-
-  _apName = apName;
-  _apPassword = apPassword;
-  bool connectedDuringConfigPortal = false;
-
-  // notify we entered AP mode
-  if (_apcallback != NULL)
+#if !defined(ESP8266)
+  if (_builtinDNS)
   {
-    _apcallback(this);
+    if (!_dns.start(DNS_PORT, WiFi.softAPIP()))
+    {
+      WM_LOGE(F("Could not start Captive DNS Server!"));
+    }
+    return;
   }
-
-  connect = false;
-  setupConfigPortal();
-  scannow = 0;
-  while (_configPortalTimeout == 0 || millis() - _configPortalStart < _configPortalTimeout)
-  {
-    esp_task_wdt_reset(); // watchdog reset
-// DNS
-#ifndef USE_EADNS
-    dnsServer->processNextRequest();
 #endif
-    //
-    //  we should do a scan every so often here and
-    //  try to reconnect to AP while we are at it
-    //
-    if (scannow == 0 || millis() - scannow >= 10000)
-    {
-      DEBUG_WM(F("About to scan()"));
-      shouldscan = true; // since we are modal, we can scan every time
-#if defined(ESP8266)
-      // we might still be connecting, so that has to stop for scanning
-      ETS_UART_INTR_DISABLE();
-      wifi_station_disconnect();
-      ETS_UART_INTR_ENABLE();
+#ifdef USE_EADNS
+  dnsServer->setErrorReplyCode(AsyncDNSReplyCode::NoError);
 #else
-      WiFi.disconnect(false);
+  dnsServer->setErrorReplyCode(DNSReplyCode::NoError);
 #endif
-      scanModal();
-      if (_tryConnectDuringConfigPortal)
-      {
-        WiFi.begin(); // try to reconnect to AP
-        connectedDuringConfigPortal = true;
-      }
-      scannow = millis();
-    }
-
-    // attempts to reconnect were successful
-    if (WiFi.status() == WL_CONNECTED)
-    {
-      // connected
-      //DEBUG_WM(F("Setting sta mode"));
-      //WiFi.mode(WIFI_STA);
-      // notify that configuration has changed and any optional parameters should be saved
-      // configuraton should not be saved when just connected using stored ssid and password during config portal
-      if (!connectedDuringConfigPortal && _savecallback != NULL)
-      {
-        // TODO: check if any custom parameters actually exist, and check if they really changed maybe
-        _savecallback();
-      }
-      break;
-    }
-
-    if (connect)
-    {
-      connect = false;
-      delay(2000);
-      DEBUG_WM(F("Connecting to new AP"));
-
-      // using user-provided _ssid, _pass in place of system-stored ssid and pass
-      WiFi.persistent(true);
-      if (_tryConnectDuringConfigPortal and connectWifi(_ssid, _pass) == WL_CONNECTED)
-      {
-        WiFi.persistent(false);
-        // connected
-        //DEBUG_WM(F("Setting sta mode"));
-        //WiFi.mode(WIFI_STA);
-        // notify that configuration has changed and any optional parameters should be saved
-        if (_savecallback != NULL)
-        {
-          // TODO: check if any custom parameters actually exist, and check if they really changed maybe
-          _savecallback();
-        }
-        break;
-      }
-      else
-      {
-          if(_tryConnectDuringConfigPortal)
-            DEBUG_WM(F("Failed to connect"));
-      }
+  if (!dnsServer->start(DNS_PORT, "*", WiFi.softAPIP()))
+  {
+    WM_LOGE(F("Could not start Captive DNS Server!"));
+  }
+}
 
-      if (_shouldBreakAfterConfig)
-      {
-        // flag set to exit after config after trying to connect
-        // notify that configuration has changed and any optional parameters should be saved
-        if (_savecallback != NULL)
-        {
-          // TODO: check if any custom parameters actually exist, and check if they really changed maybe
-          _savecallback();
-        }
-        break;
-      }
-    }
-    yield();
+// the polled DNSServer answers one query per call, the others answer on their own
+void AsyncWiFiManager::processDNS()
+{
+#ifndef USE_EADNS
+  if (!_builtinDNS)
+  {
+    dnsServer->processNextRequest();
   }
+#endif
+}
 
-  server->reset();
+void AsyncWiFiManager::stopDNS()
+{
+#if !defined(ESP8266)
+  if (_builtinDNS)
+  {
+    _dns.stop();
+    return;
+  }
+#endif
   dnsServer->stop();
+}
 
-  return WiFi.status() == WL_CONNECTED;
+void AsyncWiFiManager::setBuiltinDNS(boolean enable)
+{
+#if !defined(ESP8266)
+  _builtinDNS = enable;
+#endif
 }
 
-boolean AsyncWiFiManager::startConfigPortalSTA(char const *apName, char const *apPassword)
+AsyncWiFiManagerDNSStats AsyncWiFiManager::getDNSStats()
+{
+#if !defined(ESP8266)
+  if (_builtinDNS)
+  {
+    return _dns.stats();
+  }
+#endif
+  AsyncWiFiManagerDNSStats none = {0, 0, 0, 0};
+  return none;
+}
+
+boolean AsyncWiFiManager::startConfigPortal(char const *apName, char const *apPassword)
 {
+  startLogSink();
+  loadSettings();
+  stopPortalTask();
   // setup AP
   WiFi.mode(WIFI_AP_STA);
   DEBUG_WM(F("SET AP STA"));
@@ -836,71 +2493,52 @@ boolean AsyncWiFiManager::startConfigPortalSTA(char const *apName, char const *a
     _apcallback(this);
   }
 
-  connect = false;
+  dropConnectJob();
   setupConfigPortal();
-  scannow = 0;
+  _lastScan = 0;
+  _scanBackoff = scanInterval();
+#if !defined(ESP8266)
+  // handlers and WiFi events wake us up
+  _loopTask = xTaskGetCurrentTaskHandle();
+#endif
   while (_configPortalTimeout == 0 || millis() - _configPortalStart < _configPortalTimeout)
   {
     esp_task_wdt_reset(); // watchdog reset
-// DNS
-#ifndef USE_EADNS
-    dnsServer->processNextRequest();
-#endif
-    //
-    //  we should do a scan every so often here and
-    //  try to reconnect to AP while we are at it
-    //
-    if (scannow == 0 || millis() - scannow >= 10000)
+    updateStations();
+    processDNS();
+    if (_settingsDirty != 0 && millis() - _settingsChanged >= WIFI_MANAGER_SETTINGS_FLUSH_DELAY)
     {
-      DEBUG_WM(F("About to scan()"));
-      shouldscan = true; // since we are modal, we can scan every time
-#if defined(ESP8266)
-      // we might still be connecting, so that has to stop for scanning
-      ETS_UART_INTR_DISABLE();
-      wifi_station_disconnect();
-      ETS_UART_INTR_ENABLE();
-#else
-      WiFi.disconnect(false);
-#endif
-      scanModal();
-      if (_tryConnectDuringConfigPortal)
-      {
-        WiFi.begin(); // try to reconnect to AP
-        connectedDuringConfigPortal = true;
-      }
-      scannow = millis();
+      flushSettings();
     }
-
-    // attempts to reconnect were successful
-    if (WiFi.status() == WL_CONNECTED)
-    {
-      // connected
-      //DEBUG_WM(F("Setting sta mode"));
-      //WiFi.mode(WIFI_STA);
-      // notify that configuration has changed and any optional parameters should be saved
-      // configuraton should not be saved when just connected using stored ssid and password during config portal
-      if (!connectedDuringConfigPortal && _savecallback != NULL)
-      {
-        // TODO: check if any custom parameters actually exist, and check if they really changed maybe
-        _savecallback();
-      }
-      break;
+    runPendingAction();
+    sendEvents();
+    //
+    //  we should do a scan every so often here and
+    //  try to reconnect to AP while we are at it
+    //
+    if ((scheduleScan(true) || reconnectDue()) && _tryConnectDuringConfigPortal)
+    {
+      WiFi.begin(); // try to reconnect to AP
+      connectedDuringConfigPortal = true;
     }
 
-    if (connect)
+    AsyncWiFiManagerConnectJob job;
+    if (takeConnectJob(&job))
     {
-      connect = false;
-      delay(2000);
-      DEBUG_WM(F("Connecting to new AP"));
-
-      // using user-provided _ssid, _pass in place of system-stored ssid and pass
-      WiFi.persistent(true);
-      if (_tryConnectDuringConfigPortal and connectWifi(_ssid, _pass) == WL_CONNECTED)
+      applyConnectJob(job);
+      if (_tryConnectDuringConfigPortal)
       {
+        DEBUG_WM(F("Connecting to new AP"));
+        // using user-provided _ssid, _pass in place of system-stored ssid and pass,
+        // the portal keeps serving while it connects
+        WiFi.persistent(true);
+        beginConnect(_ssid, _pass);
         WiFi.persistent(false);
-        // connected
-        //DEBUG_WM(F("Setting sta mode"));
-        //WiFi.mode(WIFI_STA);
+        _saveConnecting = true;
+      }
+      else if (_shouldBreakAfterConfig)
+      {
+        // flag set to exit after config after trying to connect
         // notify that configuration has changed and any optional parameters should be saved
         if (_savecallback != NULL)
         {
@@ -909,15 +2547,16 @@ boolean AsyncWiFiManager::startConfigPortalSTA(char const *apName, char const *a
         }
         break;
       }
-      else
-      {
-          if(_tryConnectDuringConfigPortal)
-            DEBUG_WM(F("Failed to connect"));
-      }
+    }
 
-      if (_shouldBreakAfterConfig)
+    if (_saveConnecting)
+    {
+      AsyncWiFiManagerConnectState state = pollConnect();
+      if (state == WM_CONNECT_CONNECTED)
       {
-        // flag set to exit after config after trying to connect
+        _saveConnecting = false;
+        storeFastReconnect();
+        setInfo();
         // notify that configuration has changed and any optional parameters should be saved
         if (_savecallback != NULL)
         {
@@ -926,22 +2565,111 @@ boolean AsyncWiFiManager::startConfigPortalSTA(char const *apName, char const *a
         }
         break;
       }
+      if (!connectPending(state))
+      {
+        _saveConnecting = false;
+        WM_LOGI(F("Failed to connect"));
+        setInfo();
+        if (_shouldBreakAfterConfig)
+        {
+          // flag set to exit after config after trying to connect
+          // notify that configuration has changed and any optional parameters should be saved
+          if (_savecallback != NULL)
+          {
+            // TODO: check if any custom parameters actually exist, and check if they really changed maybe
+            _savecallback();
+          }
+          break;
+        }
+      }
+    }
+
+    // attempts to reconnect were successful, a pending save attempt reports itself above
+    if (!_saveConnecting && WiFi.status() == WL_CONNECTED)
+    {
+      // connected
+      //DEBUG_WM(F("Setting sta mode"));
+      //WiFi.mode(WIFI_STA);
+      // notify that configuration has changed and any optional parameters should be saved
+      // configuraton should not be saved when just connected using stored ssid and password during config portal
+      if (!connectedDuringConfigPortal && _savecallback != NULL)
+      {
+        // TODO: check if any custom parameters actually exist, and check if they really changed maybe
+        _savecallback();
+      }
+      break;
     }
-    yield();
+
+    waitForWork();
   }
+#if !defined(ESP8266)
+  _loopTask = NULL;
+#endif
 
   server->reset();
-  dnsServer->stop();
+  _events = NULL;
+  stopDNS();
+  flushSettings();
 
   return WiFi.status() == WL_CONNECTED;
 }
 
+boolean AsyncWiFiManager::startConfigPortalSTA(char const *apName, char const *apPassword)
+{
+  return startConfigPortal(apName, apPassword);
+}
+
 uint8_t AsyncWiFiManager::connectWifi(String ssid, String pass)
+{
+  uint8_t connRes = WL_DISCONNECTED;
+  if (ssid == "" && _fastReconnect && beginFastReconnect())
+  {
+    connRes = waitForConnectResult();
+    if (connRes != WL_CONNECTED)
+    {
+      DEBUG_WM(F("Fast reconnect failed, doing a full connect"));
+      forgetFastReconnect();
+      if (!_sta_static_ip)
+      {
+        // back to DHCP
+        WiFi.config((uint32_t)0, (uint32_t)0, (uint32_t)0);
+      }
+    }
+  }
+  if (connRes != WL_CONNECTED)
+  {
+    beginConnect(ssid, pass);
+    connRes = waitForConnectResult();
+  }
+  WM_LOGI(F("Connection result: "));
+  WM_LOGI(connRes);
+  // not connected, WPS enabled, no pass - first attempt
+#if WM_FEATURE_WPS
+  if (_tryWPS && connRes != WL_CONNECTED && pass == "")
+  {
+    startConnectAttempt();
+    startWPS();
+    // should be connected at the end of WPS
+    connRes = waitForConnectResult();
+  }
+#endif
+  if (connRes == WL_CONNECTED)
+  {
+    storeFastReconnect();
+  }
+  DEBUG_WM(F("Setting info"));
+  setInfo();
+  return connRes;
+}
+
+// start a connection attempt and return right away, follow it with
+// pollConnect(), waitForConnect() or the connect callback
+void AsyncWiFiManager::beginConnect(String ssid, String pass, boolean staticIP)
 {
   DEBUG_WM(F("Connecting as wifi client..."));
 
   // check if we've got static_ip settings, if we do, use those
-  if (_sta_static_ip)
+  if (staticIP && _sta_static_ip)
   {
     DEBUG_WM(F("Custom STA IP/GW/Subnet/DNS"));
     WiFi.config(_sta_static_ip, _sta_static_gw, _sta_static_sn, _sta_static_dns1, _sta_static_dns2);
@@ -953,8 +2681,12 @@ uint8_t AsyncWiFiManager::connectWifi(String ssid, String pass)
   //    return WL_CONNECTED;
   //  }
   // check if we have ssid and pass and force those, if not, try with last saved values
-  if (ssid != "")
+  if (ssid != "" || WiFi.SSID().length() > 0)
   {
+    if (ssid == "")
+    {
+      DEBUG_WM(F("Using last saved values, should be faster"));
+    }
 #if defined(ESP8266)
     // trying to fix connection in progress hanging
     ETS_UART_INTR_DISABLE();
@@ -963,125 +2695,527 @@ uint8_t AsyncWiFiManager::connectWifi(String ssid, String pass)
 #else
     WiFi.disconnect(false);
 #endif
+  }
+  else
+  {
+    DEBUG_WM(F("Try to connect with saved credentials"));
+  }
+
+  startConnectAttempt();
+  if (ssid != "")
+  {
     WiFi.begin(ssid.c_str(), pass.c_str());
   }
   else
   {
-    if (WiFi.SSID().length() > 0)
+    WiFi.begin();
+  }
+}
+
+void AsyncWiFiManager::startConnectAttempt(unsigned long timeoutMs)
+{
+#if !defined(ESP8266)
+  if (_connectEvents == NULL)
+  {
+    _connectEvents = xEventGroupCreate();
+  }
+  if (_connectEventId == 0)
+  {
+    // one handler for all events, it filters the ones it cares about
+    _connectEventId = WiFi.onEvent(std::bind(&AsyncWiFiManager::onConnectEvent, this,
+                                             std::placeholders::_1, std::placeholders::_2));
+  }
+#endif
+  if (timeoutMs == 0)
+  {
+    timeoutMs = _connectTimeout != 0 ? _connectTimeout : WIFI_MANAGER_CONNECT_TIMEOUT;
+  }
+  // never run past the time to portal
+  timeoutMs = std::min(timeoutMs, connectTimeLeft());
+  _attemptTimeout = timeoutMs;
+  _disconnectReason = 0;
+  _connectStarted = millis();
+  _connectState = WM_CONNECT_CONNECTING;
+}
+
+void AsyncWiFiManager::setConnectState(AsyncWiFiManagerConnectState state)
+{
+  uint8_t previous = _connectState.exchange(state);
+  if (previous != state)
+  {
+    wake(); // the loop tells the events stream
+  }
+  // report each attempt once, whoever decides it first
+  if (connectPending(previous) && !connectPending(state) && _connectcallback != NULL)
+  {
+    _connectcallback(state, _disconnectReason);
+  }
+}
+
+#if !defined(ESP8266)
+void AsyncWiFiManager::onConnectEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  switch (event)
+  {
+  case SYSTEM_EVENT_STA_CONNECTED:
+    if (_connectState == WM_CONNECT_CONNECTING)
     {
-      DEBUG_WM(F("Using last saved values, should be faster"));
+      setConnectState(WM_CONNECT_ASSOCIATED);
+    }
+    break;
+  case SYSTEM_EVENT_STA_GOT_IP:
+    setConnectState(WM_CONNECT_CONNECTED);
+    break;
+  case SYSTEM_EVENT_STA_DISCONNECTED:
+    _disconnectReason = info.disconnected.reason;
+    if (_connectState == WM_CONNECT_CONNECTED)
+    {
+      setConnectState(WM_CONNECT_LOST);
+    }
+    else if (connectPending(_connectState))
+    {
+      // give up right away when retrying cannot help, anything else the
+      // driver retries until the timeout
+      if (hopelessReason(_disconnectReason))
+      {
+        DEBUG_WM(F("Connect aborted, reason"));
+        DEBUG_WM(_disconnectReason.load());
+        setConnectState(WM_CONNECT_FAILED);
+      }
+      else
+      {
+        _connectState = WM_CONNECT_CONNECTING;
+      }
+    }
+    break;
+  default:
+    return;
+  }
+  if (event != SYSTEM_EVENT_STA_CONNECTED)
+  {
+    refreshLiveInfo(); // got or lost the address
+  }
+  xEventGroupSetBits(_connectEvents, WM_CONNECT_EVENT_BIT);
+  wake();
+}
+#endif
+
+// move the state machine along, applies the connect timeout
+AsyncWiFiManagerConnectState AsyncWiFiManager::pollConnect()
+{
+#if defined(ESP8266)
+  // no event hookup here, follow the status instead
+  wl_status_t status = WiFi.status();
+  if (status == WL_CONNECTED && _connectState != WM_CONNECT_CONNECTED)
+  {
+    setConnectState(WM_CONNECT_CONNECTED);
+  }
+  else if (status != WL_CONNECTED && _connectState == WM_CONNECT_CONNECTED)
+  {
+    setConnectState(WM_CONNECT_LOST);
+  }
+  else if ((status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL) && connectPending(_connectState))
+  {
+    setConnectState(WM_CONNECT_FAILED);
+  }
+#endif
+  if (connectPending(_connectState) && millis() - _connectStarted >= _attemptTimeout)
+  {
+    DEBUG_WM(F("Connection timed out"));
+    setConnectState(WM_CONNECT_TIMEOUT);
+  }
+  return (AsyncWiFiManagerConnectState)_connectState.load();
+}
+
+// Block until the current attempt is decided, or with untilConnected until the
+// station is connected, for at most timeoutMs. Woken up by the WiFi events, the
+// short slices only keep the watchdog fed.
+AsyncWiFiManagerConnectState AsyncWiFiManager::waitForConnect(unsigned long timeoutMs, boolean untilConnected)
+{
+  unsigned long start = millis();
+  while (true)
+  {
+    esp_task_wdt_reset(); // watchdog reset
+#if !defined(ESP8266)
+    xEventGroupClearBits(_connectEvents, WM_CONNECT_EVENT_BIT);
+#endif
+    AsyncWiFiManagerConnectState state = pollConnect();
+    if (untilConnected ? state == WM_CONNECT_CONNECTED : !connectPending(state))
+    {
+      return state;
+    }
+    unsigned long elapsed = millis() - start;
+    if (timeoutMs != 0 && elapsed >= timeoutMs)
+    {
+      return state;
+    }
+    unsigned long slice = timeoutMs != 0 ? std::min(timeoutMs - elapsed, 100ul) : 100ul;
 #if defined(ESP8266)
-      // trying to fix connection in progress hanging
-      ETS_UART_INTR_DISABLE();
-      wifi_station_disconnect();
-      ETS_UART_INTR_ENABLE();
+    delay(std::min(slice, 10ul));
 #else
-      WiFi.disconnect(false);
+    xEventGroupWaitBits(_connectEvents, WM_CONNECT_EVENT_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(slice));
 #endif
-      WiFi.begin();
+  }
+}
+
+uint8_t AsyncWiFiManager::waitForConnectResult()
+{
+  DEBUG_WM(F("Waiting for connection result"));
+  switch (waitForConnect(0, false))
+  {
+  case WM_CONNECT_CONNECTED:
+    return WL_CONNECTED;
+  case WM_CONNECT_FAILED:
+    return WL_CONNECT_FAILED;
+  default:
+    return WiFi.status();
+  }
+}
+
+boolean AsyncWiFiManager::addNetwork(const char *ssid, const char *pass)
+{
+  if (pass == NULL)
+  {
+    pass = "";
+  }
+  if (ssid == NULL || ssid[0] == '\0' || strlen(ssid) > 32 || strlen(pass) > 64)
+  {
+    return false;
+  }
+  loadSettings();
+  WM_SETTINGS_LOCK();
+  AsyncWiFiManagerNetworkStore &store = _networkStore;
+  int i = findNetwork(&store, ssid);
+  // saving the network in use again changes nothing
+  boolean changed = i != 0 || strcmp(store.networks[0].pass, pass) != 0;
+  if (i < 0)
+  {
+    // when full the least recently used one makes room
+    i = store.count < WIFI_MANAGER_MAX_NETWORKS ? store.count++ : WIFI_MANAGER_MAX_NETWORKS - 1;
+    strncpy(store.networks[i].ssid, ssid, sizeof(store.networks[i].ssid) - 1);
+    store.networks[i].ssid[sizeof(store.networks[i].ssid) - 1] = '\0';
+  }
+  strncpy(store.networks[i].pass, pass, sizeof(store.networks[i].pass) - 1);
+  store.networks[i].pass[sizeof(store.networks[i].pass) - 1] = '\0';
+  promoteNetwork(&store, i);
+  WM_SETTINGS_UNLOCK();
+  if (changed)
+  {
+    markSettings(WM_SETTING_NETWORKS);
+  }
+  return true;
+}
+
+boolean AsyncWiFiManager::removeNetwork(const char *ssid)
+{
+  loadSettings();
+  WM_SETTINGS_LOCK();
+  AsyncWiFiManagerNetworkStore &store = _networkStore;
+  int i = findNetwork(&store, ssid);
+  if (i >= 0)
+  {
+    store.count--;
+    memmove(&store.networks[i], &store.networks[i + 1], (store.count - i) * sizeof(AsyncWiFiManagerStoredNetwork));
+    memset(&store.networks[store.count], 0, sizeof(AsyncWiFiManagerStoredNetwork));
+  }
+  WM_SETTINGS_UNLOCK();
+  if (i < 0)
+  {
+    return false;
+  }
+  markSettings(WM_SETTING_NETWORKS);
+  return true;
+}
+
+uint8_t AsyncWiFiManager::getNetworkCount()
+{
+  loadSettings();
+  return _networkStore.count;
+}
+
+// Called after the last network failed: one scan, then the stored networks in
+// range strongest first, each with the connect timeout. The scan also fills
+// the portal's list should we end up there.
+boolean AsyncWiFiManager::connectKnownNetwork()
+{
+  // a copy, the portal may save a network meanwhile
+  AsyncWiFiManagerNetworkStore store;
+  loadSettings();
+  WM_SETTINGS_LOCK();
+  memcpy(&store, &_networkStore, sizeof(store));
+  WM_SETTINGS_UNLOCK();
+  if (store.count < 2)
+  {
+    return false; // nothing besides the one that just failed
+  }
+
+  DEBUG_WM(F("Scanning for known networks"));
+  WiFi.disconnect(false); // a pending attempt makes the scan fail
+  if (!startScan())
+  {
+    return false;
+  }
+  while (_scanRunning && !finishScan())
+  {
+    if (connectTimeLeft() <= 1)
+    {
+      return false; // the portal harvests it
     }
-    else
+    esp_task_wdt_reset(); // watchdog reset
+    delay(50);
+  }
+
+  // the scan is sorted strongest first
+  uint8_t candidates[WIFI_MANAGER_MAX_NETWORKS];
+  uint8_t candidateCount = 0;
+  {
+    AsyncWiFiManagerScanSnapshot snapshot(&_scanPool);
+    const WiFiResult *results = snapshot.records();
+    boolean seen[WIFI_MANAGER_MAX_NETWORKS] = {false};
+    seen[0] = true; // the one that just failed
+    for (int r = 0; r < snapshot.count(); r++)
     {
-      DEBUG_WM(F("Try to connect with saved credentials"));
-      WiFi.begin();
+      int i = findNetwork(&store, results[r].SSID);
+      if (i >= 0 && !seen[i])
+      {
+        seen[i] = true;
+        candidates[candidateCount++] = i;
+      }
     }
   }
 
-  uint8_t connRes = waitForConnectResult();
-  DEBUG_WM(F("Connection result: "));
-  DEBUG_WM(connRes);
-  // not connected, WPS enabled, no pass - first attempt
-#ifdef NO_EXTRA_4K_HEAP
-  if (_tryWPS && connRes != WL_CONNECTED && pass == "")
+  for (uint8_t c = 0; c < candidateCount && connectTimeLeft() > 1; c++)
   {
-    startWPS();
-    // should be connected at the end of WPS
-    connRes = waitForConnectResult();
+    AsyncWiFiManagerStoredNetwork &network = store.networks[candidates[c]];
+    DEBUG_WM(F("Trying known network"));
+    DEBUG_WM(network.ssid);
+    // persisted, so the next boot starts with this one
+    WiFi.persistent(true);
+    beginConnect(network.ssid, network.pass);
+    WiFi.persistent(false);
+    if (waitForConnectResult() == WL_CONNECTED)
+    {
+      WM_SETTINGS_LOCK();
+      int i = findNetwork(&_networkStore, network.ssid);
+      if (i > 0)
+      {
+        promoteNetwork(&_networkStore, i);
+      }
+      WM_SETTINGS_UNLOCK();
+      markSettings(WM_SETTING_NETWORKS);
+      storeFastReconnect();
+      setInfo();
+      return true;
+    }
   }
-#endif
-  DEBUG_WM(F("Setting info"));
+  WM_LOGI(F("No known network in range"));
   setInfo();
-  return connRes;
+  return false;
 }
 
-uint8_t AsyncWiFiManager::connectWifiSTA(String ssid, String pass)
+// join the cached BSSID on its channel, skipping the channel sweep and with a
+// cached lease also DHCP
+boolean AsyncWiFiManager::beginFastReconnect()
 {
-  DEBUG_WM(F("Connecting as wifi client..."));
+  AsyncWiFiManagerFastReconnect record;
+  loadSettings();
+  WM_SETTINGS_LOCK();
+  boolean valid = _fastReconnectValid;
+  memcpy(&record, &_fastReconnectRecord, sizeof(record));
+  WM_SETTINGS_UNLOCK();
+  if (!valid)
+  {
+    return false;
+  }
+  DEBUG_WM(F("Fast reconnect to"));
+  DEBUG_WM(record.ssid);
+  if (_sta_static_ip)
+  {
+    WiFi.config(_sta_static_ip, _sta_static_gw, _sta_static_sn, _sta_static_dns1, _sta_static_dns2);
+  }
+  else if (record.ip != 0)
+  {
+    WiFi.config(IPAddress(record.ip), IPAddress(record.gw), IPAddress(record.sn), IPAddress(record.dns));
+  }
+  startConnectAttempt(WIFI_MANAGER_FAST_CONNECT_TIMEOUT);
+  WiFi.begin(record.ssid, WiFi.psk().c_str(), record.channel, record.bssid);
+  return true;
+}
 
-  // check if we've got static_ip settings, if we do, use those
-  // fix for auto connect racing issue
-  //  if (WiFi.status() == WL_CONNECTED) {
-  //    DEBUG_WM("Already connected. Bailing out.");
-  //    return WL_CONNECTED;
-  //  }
-  // check if we have ssid and pass and force those, if not, try with last saved values
-  if (ssid != "")
+void AsyncWiFiManager::storeFastReconnect()
+{
+  if (!_fastReconnect || WiFi.status() != WL_CONNECTED)
+  {
+    return;
+  }
+  AsyncWiFiManagerFastReconnect record;
+  memset(&record, 0, sizeof(record));
+  record.version = WIFI_MANAGER_FAST_RECONNECT_VERSION;
+  record.channel = WiFi.channel();
+  memcpy(record.bssid, WiFi.BSSID(), sizeof(record.bssid));
+  strncpy(record.ssid, WiFi.SSID().c_str(), sizeof(record.ssid) - 1);
+  if (_fastReconnectLease && !_sta_static_ip)
+  {
+    record.ip = WiFi.localIP();
+    record.gw = WiFi.gatewayIP();
+    record.sn = WiFi.subnetMask();
+    record.dns = WiFi.dnsIP();
+  }
+  loadSettings();
+  WM_SETTINGS_LOCK();
+  boolean changed = !_fastReconnectValid || memcmp(&_fastReconnectRecord, &record, sizeof(record)) != 0;
+  memcpy(&_fastReconnectRecord, &record, sizeof(record));
+  _fastReconnectValid = true;
+  WM_SETTINGS_UNLOCK();
+  if (!changed)
+  {
+    return; // unchanged, spare the flash
+  }
+  DEBUG_WM(F("Storing fast reconnect cache"));
+  markSettings(WM_SETTING_FAST_RECONNECT);
+}
+
+void AsyncWiFiManager::forgetFastReconnect()
+{
+  loadSettings();
+  WM_SETTINGS_LOCK();
+  boolean valid = _fastReconnectValid;
+  _fastReconnectValid = false;
+  WM_SETTINGS_UNLOCK();
+  if (valid)
+  {
+    markSettings(WM_SETTING_FAST_RECONNECT);
+  }
+}
+
+// read all manager keys once, later reads are served from RAM
+void AsyncWiFiManager::loadSettings()
+{
+  if (_settingsLoaded)
+  {
+    return;
+  }
+  _settingsLoaded = true;
+#if WM_FEATURE_STAND_ALONE
+  _standAlone = NVS.getInt(NVS_STAND_ALONE);
+#endif
+  _fastReconnectValid = loadFastReconnect(&_fastReconnectRecord);
+  loadNetworks(&_networkStore);
+}
+
+void AsyncWiFiManager::markSettings(uint8_t dirty)
+{
+  _settingsChanged = millis();
+  _settingsDirty |= dirty;
+  // the loop writes them, woken if it would sleep past the delay
+  wakeIn(WIFI_MANAGER_SETTINGS_FLUSH_DELAY);
+}
+
+// one commit for whatever changed since the last flush
+void AsyncWiFiManager::flushSettings()
+{
+  uint8_t dirty = _settingsDirty.exchange(0);
+  if (dirty == 0)
   {
-    WiFi.disconnect(false);
-    WiFi.begin(ssid.c_str(), pass.c_str());
+    return;
   }
-  else
+  DEBUG_WM(F("Writing settings"));
+#if WM_FEATURE_STAND_ALONE
+  if (dirty & WM_SETTING_STAND_ALONE)
+  {
+    NVS.setInt(NVS_STAND_ALONE, _standAlone ? 1 : 0, false);
+  }
+#endif
+  if (dirty & WM_SETTING_NETWORKS)
   {
-    if (WiFi.SSID().length() > 0)
+    AsyncWiFiManagerNetworkStore store;
+    WM_SETTINGS_LOCK();
+    memcpy(&store, &_networkStore, sizeof(store));
+    WM_SETTINGS_UNLOCK();
+    if (store.count > 0)
     {
-      DEBUG_WM(F("Using last saved values, should be faster"));
-      WiFi.disconnect(false);
-      WiFi.begin();
+      NVS.setBlob(WIFI_MANAGER_NVS_NETWORKS, (uint8_t *)&store, sizeof(store), false);
     }
-    else
+    else if (NVS.getBlobSize(WIFI_MANAGER_NVS_NETWORKS) > 0)
     {
-      DEBUG_WM(F("Try to connect with saved credentials"));
-      WiFi.begin();
+      NVS.erase(WIFI_MANAGER_NVS_NETWORKS, false);
     }
   }
-
-  uint8_t connRes = waitForConnectResult();
-  DEBUG_WM(F("Connection result: "));
-  DEBUG_WM(connRes);
-  // not connected, WPS enabled, no pass - first attempt
-#ifdef NO_EXTRA_4K_HEAP
-  if (_tryWPS && connRes != WL_CONNECTED && pass == "")
+  if (dirty & WM_SETTING_FAST_RECONNECT)
   {
-    startWPS();
-    // should be connected at the end of WPS
-    connRes = waitForConnectResult();
+    AsyncWiFiManagerFastReconnect record;
+    WM_SETTINGS_LOCK();
+    boolean valid = _fastReconnectValid;
+    memcpy(&record, &_fastReconnectRecord, sizeof(record));
+    WM_SETTINGS_UNLOCK();
+    if (valid)
+    {
+      NVS.setBlob(WIFI_MANAGER_NVS_FAST_RECONNECT, (uint8_t *)&record, sizeof(record), false);
+    }
+    else if (NVS.getBlobSize(WIFI_MANAGER_NVS_FAST_RECONNECT) > 0)
+    {
+      NVS.erase(WIFI_MANAGER_NVS_FAST_RECONNECT, false);
+    }
   }
-#endif
-  DEBUG_WM(F("Setting info"));
-  return connRes;
+  NVS.commit();
 }
 
-uint8_t AsyncWiFiManager::waitForConnectResult()
+#if WM_FEATURE_STAND_ALONE
+boolean AsyncWiFiManager::getStandAlone()
+{
+  loadSettings();
+  return _standAlone;
+}
+
+void AsyncWiFiManager::setStandAlone(boolean standAlone)
 {
-  if (_connectTimeout == 0)
+  loadSettings();
+  if (_standAlone == standAlone)
   {
-    return WiFi.waitForConnectResult();
+    return; // unchanged, spare the flash
   }
-  else
+  _standAlone = standAlone;
+  markSettings(WM_SETTING_STAND_ALONE);
+}
+#endif
+
+// time left before autoConnect gives up and opens the portal
+unsigned long AsyncWiFiManager::connectTimeLeft()
+{
+  if (_connectDeadline == 0)
   {
-    DEBUG_WM(F("Waiting for connection result with time out"));
-    unsigned long start = millis();
-    boolean keepConnecting = true;
-    uint8_t status;
-    while (keepConnecting)
-    {
-      esp_task_wdt_reset(); // watchdog reset
-      status = WiFi.status();
-      if (millis() > start + _connectTimeout)
-      {
-        keepConnecting = false;
-        DEBUG_WM(F("Connection timed out"));
-      }
-      if (status == WL_CONNECTED || status == WL_CONNECT_FAILED)
-      {
-        keepConnecting = false;
-      }
-      delay(100);
-    }
-    return status;
+    return ULONG_MAX;
   }
+  long left = (long)(_connectDeadline - millis());
+  return left > 0 ? left : 1;
+}
+
+void AsyncWiFiManager::setMaxTimeToPortal(unsigned long seconds)
+{
+  _maxTimeToPortal = seconds * 1000;
+}
+
+void AsyncWiFiManager::setFastReconnect(boolean enable, boolean cacheIpLease)
+{
+  _fastReconnect = enable;
+  _fastReconnectLease = cacheIpLease;
+}
+
+AsyncWiFiManagerConnectState AsyncWiFiManager::getConnectState()
+{
+  return pollConnect();
+}
+
+uint8_t AsyncWiFiManager::getDisconnectReason()
+{
+  return _disconnectReason;
 }
-#ifdef NO_EXTRA_4K_HEAP
+
+void AsyncWiFiManager::setConnectCallback(std::function<void(AsyncWiFiManagerConnectState, uint8_t)> func)
+{
+  _connectcallback = func;
+}
+#if WM_FEATURE_WPS
 void AsyncWiFiManager::startWPS()
 {
   DEBUG_WM(F("START WPS"));
@@ -1121,6 +3255,14 @@ void AsyncWiFiManager::resetSettings()
   WiFi.disconnect(true, true);
 #endif
   WiFi.persistent(false);
+  forgetFastReconnect();
+  WM_SETTINGS_LOCK();
+  memset(&_networkStore, 0, sizeof(_networkStore));
+  _networkStore.version = WIFI_MANAGER_NETWORK_STORE_VERSION;
+  WM_SETTINGS_UNLOCK();
+  markSettings(WM_SETTING_NETWORKS);
+  // sketches restart right after this
+  flushSettings();
 
   //delay(200);
 }
@@ -1181,714 +3323,1045 @@ void AsyncWiFiManager::setBreakAfterConfig(boolean shouldBreak)
   _shouldBreakAfterConfig = shouldBreak;
 }
 
-// handle root or redirect to captive portal
-void AsyncWiFiManager::handleRoot(AsyncWebServerRequest *request)
+// Pages are streamed with a chunked response: the renderer is run once per
+// chunk and only the bytes of that chunk are kept. The renderer therefore has
+// to produce the same output on every run, so anything that may change while
+// the response is in flight is captured by the handler up front.
+AsyncWebServerResponse *AsyncWiFiManager::beginPageResponse(AsyncWebServerRequest *request,
+                                                            AsyncWiFiManagerRenderer render,
+                                                            const char *contentType)
 {
-  // AJS - maybe we should set a scan when we get to the root???
-  // and only scan on demand? timer + on demand? plus a link to make it happen?
-
-  shouldscan = true;
-  scannow = 0;
-  DEBUG_WM(F("Handle root"));
-
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  if (captivePortal(request))
-  {
-    // if captive portal redirect instead of displaying the page
-    return;
-  }
-
-  DEBUG_WM(F("Sending Captive Portal"));
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Options");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += "<h1>";
-  page += _apName;
-  page += "</h1>";
-  page += F("<h3><center>Xenia WiFi Manager</center></h3>");
-  page += FPSTR(HTTP_PORTAL_OPTIONS);
-  page += NVS.getInt(NVS_STAND_ALONE) ? "<p style=\"color:green;\">ACTIVATED</p>" : "<p style=\"color:red;\">DEACTIVATED</p>";
-  page += FPSTR(HTTP_PORTAL_OPTIONS2);
-  page += _customOptionsElement;
-  page += FPSTR(HTTP_END);
-
-  AsyncWebServerResponse *response = request->beginResponse(200, "text/html", page);
-  response->addHeader("Cache-control","no-cache	");
-  request->send(response);
-  
-  DEBUG_WM(F("Sent..."));
+#ifdef USE_WM_METRICS
+  AsyncWiFiManagerRouteMetrics *metrics = _currentMetrics;
+#endif
+  // the page holds its route's in-flight slot until it is written out
+  std::shared_ptr<AsyncWiFiManagerAdmission> admission = _currentAdmission;
+  return request->beginChunkedResponse(contentType,
+                                       [=](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                       {
+                                         (void)admission;
+                                         AsyncWiFiManagerChunkPrint out(buffer, maxLen, index);
+                                         render(out);
+#ifdef USE_WM_METRICS
+                                         if (metrics != NULL)
+                                         {
+                                           metrics->bytes += out.length();
+                                         }
+#endif
+                                         return out.length();
+                                       });
 }
 
-// handle root or redirect to captive portal
-void AsyncWiFiManager::handleRootSTA(AsyncWebServerRequest *request)
+void AsyncWiFiManager::sendPage(AsyncWebServerRequest *request,
+                                AsyncWiFiManagerRenderer render,
+                                const char *contentType)
 {
-  // AJS - maybe we should set a scan when we get to the root???
-  // and only scan on demand? timer + on demand? plus a link to make it happen?
-
-  DEBUG_WM(F("Handle root"));
-
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Options");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  //page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("<h3><center>Xenia WiFi Manager</center></h3>");
-  page += FPSTR(HTTP_PORTAL_OPTIONS_STA);
-  page += NVS.getInt(NVS_STAND_ALONE) ? "<p style=\"color:green;\">ACTIVATED</p>" : "<p style=\"color:red;\">DEACTIVATED</p>";
-  page += FPSTR(HTTP_PORTAL_OPTIONS2);
-  //page += _customOptionsElement;
-  page += FPSTR(HTTP_END);
-
-  AsyncWebServerResponse *response = request->beginResponse(200, "text/html", page);
-  response->addHeader("Cache-control","no-cache	");
-  request->send(response);
-
-  DEBUG_WM(F("Sent..."));
+  request->send(beginPageResponse(request, render, contentType));
 }
 
-// wifi config page handler
-void AsyncWiFiManager::handleWifi(AsyncWebServerRequest *request, boolean scan)
+boolean AsyncWiFiManager::wantsJson(AsyncWebServerRequest *request)
 {
-  shouldscan = true;
-  scannow = 0;
-
-  DEBUG_WM(F("Handle wifi"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Config ESP");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-
-  if (scan)
+  if (request->arg("format") == "json")
   {
-    wifiSSIDscan = false;
-
-    DEBUG_WM(F("Scan done"));
-    if (wifiSSIDCount == 0)
-    {
-      DEBUG_WM(F("No networks found"));
-      page += F("No networks found. Refresh to scan again");
-    }
-    else
-    {
-      // display networks in page
-      String pager = networkListAsString();
-      page += pager;
-      page += "<br/>";
-    }
+    return true;
   }
-  wifiSSIDscan = true;
-
-  page += FPSTR(HTTP_FORM_START);
-  char parLength[2];
+  return request->hasHeader("Accept") && request->header("Accept").indexOf("application/json") >= 0;
+}
 
-  // add the extra parameters to the form
-  for (unsigned int i = 0; i < _paramsCount; i++)
+// {"scanning":false,"age":4,"networks":[{"ssid":"..","bssid":"..",...}]}
+void AsyncWiFiManager::sendScanJson(AsyncWebServerRequest *request)
+{
+  std::shared_ptr<AsyncWiFiManagerScanSnapshot> snapshot(new AsyncWiFiManagerScanSnapshot(&_scanPool));
+  boolean scanning = _scanRunning;
+  long age = snapshot->published() ? (long)((millis() - snapshot->publishedAt()) / 1000) : -1;
+  request->send(beginScanResponse(request, *snapshot, [this, snapshot, scanning, age](Print &out)
   {
-    if (_params[i] == NULL)
-    {
-      break;
-    }
-
-    String pitem = FPSTR(HTTP_FORM_PARAM);
-    if (_params[i]->getID() != NULL)
+    AsyncWiFiManagerJsonWriter json(out);
+    json.beginObject();
+    json.key("scanning");
+    json.value(scanning);
+    json.key("age");
+    if (age >= 0)
     {
-      pitem.replace("{i}", _params[i]->getID());
-      pitem.replace("{n}", _params[i]->getID());
-      pitem.replace("{p}", _params[i]->getPlaceholder());
-      snprintf(parLength, 2, "%d", _params[i]->getValueLength());
-      pitem.replace("{l}", parLength);
-      pitem.replace("{v}", _params[i]->getValue());
-      pitem.replace("{c}", _params[i]->getCustomHTML());
+      json.value(age);
     }
     else
     {
-      pitem = _params[i]->getCustomHTML();
+      json.null();
     }
+    json.key("networks");
+    renderNetworkListJson(json, *snapshot);
+    json.endObject();
+  }, true));
+}
 
-    page += pitem;
-  }
-  if (_params[0] != NULL)
+void AsyncWiFiManager::renderNetworkListJson(AsyncWiFiManagerJsonWriter &json, AsyncWiFiManagerScanSnapshot &snapshot)
+{
+  const WiFiResult *results = snapshot.records();
+  json.beginArray();
+  for (int i = 0; i < snapshot.count(); i++)
   {
-    page += "<br/>";
+    char bssid[18];
+    snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X",
+             results[i].BSSID[0], results[i].BSSID[1], results[i].BSSID[2],
+             results[i].BSSID[3], results[i].BSSID[4], results[i].BSSID[5]);
+#if defined(ESP8266)
+    boolean secure = results[i].encryptionType != ENC_TYPE_NONE;
+#else
+    boolean secure = results[i].encryptionType != WIFI_AUTH_OPEN;
+#endif
+    json.beginObject();
+    json.key("ssid");
+    json.value(results[i].SSID);
+    json.key("bssid");
+    json.value(bssid);
+    json.key("rssi");
+    json.value(results[i].RSSI);
+    json.key("quality");
+    json.value(getRSSIasQuality(results[i].RSSI));
+    json.key("channel");
+    json.value(results[i].channel);
+    json.key("secure");
+    json.value(secure);
+    json.key("hidden");
+    json.value(results[i].isHidden != 0);
+    json.endObject();
   }
-  if (_sta_static_ip)
-  {
-    String item = FPSTR(HTTP_FORM_PARAM);
-    item.replace("{i}", "ip");
-    item.replace("{n}", "ip");
-    item.replace("{p}", "Static IP");
-    item.replace("{l}", "15");
-    item.replace("{v}", _sta_static_ip.toString());
+  json.endArray();
+}
 
-    page += item;
+void AsyncWiFiManager::sendSavedJson(AsyncWebServerRequest *request, const String &ssid)
+{
+  sendPage(request, [ssid](Print &out)
+  {
+    AsyncWiFiManagerJsonWriter json(out);
+    json.beginObject();
+    json.key("saved");
+    json.value(true);
+    json.key("ssid");
+    json.value(ssid);
+    json.endObject();
+  }, "application/json");
+}
 
-    item = FPSTR(HTTP_FORM_PARAM);
-    item.replace("{i}", "gw");
-    item.replace("{n}", "gw");
-    item.replace("{p}", "Static Gateway");
-    item.replace("{l}", "15");
-    item.replace("{v}", _sta_static_gw.toString());
+#if WM_FEATURE_STAND_ALONE
+void AsyncWiFiManager::sendStandAloneJson(AsyncWebServerRequest *request)
+{
+  boolean standAlone = getStandAlone();
+  sendPage(request, [standAlone](Print &out)
+  {
+    AsyncWiFiManagerJsonWriter json(out);
+    json.beginObject();
+    json.key("standAlone");
+    json.value(standAlone);
+    json.key("activate");
+    json.value("/api/v2/wifi/stand_alone_yes");
+    json.key("deactivate");
+    json.value("/api/v2/wifi/stand_alone_no");
+    json.endObject();
+  }, "application/json");
+}
+#endif
 
-    page += item;
+void AsyncWiFiManager::renderHead(Print &out,
+                                  const char *title,
+                                  const char *headElement,
+                                  const __FlashStringHelper *extra)
+{
+  const char *values[] = {title};
+  headTemplate.render(out, values);
+  out.print(FPSTR(HTTP_HEAD_ASSETS));
+  out.print(headElement);
+  if (extra != NULL)
+  {
+    out.print(extra);
+  }
+  out.print(FPSTR(HTTP_HEAD_END));
+}
 
-    item = FPSTR(HTTP_FORM_PARAM);
-    item.replace("{i}", "sn");
-    item.replace("{n}", "sn");
-    item.replace("{p}", "Subnet");
-    item.replace("{l}", "15");
-    item.replace("{v}", _sta_static_sn.toString());
+#if WM_FEATURE_STATIC_IP
+void AsyncWiFiManager::renderIPParam(Print &out, const char *id, const char *placeholder, IPAddress ip)
+{
+  char value[16];
+  snprintf(value, sizeof(value), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  const char *values[] = {id, id, placeholder, "15", value, ""};
+  paramTemplate.render(out, values);
+}
+#endif
 
-    page += item;
+const char *AsyncWiFiManager::headElement(AsyncWiFiManagerPortalMode mode)
+{
+  return mode == WM_MODE_AP ? _customHeadElement : "";
+}
 
-    item = FPSTR(HTTP_FORM_PARAM);
-    item.replace("{i}", "dns1");
-    item.replace("{n}", "dns1");
-    item.replace("{p}", "DNS1");
-    item.replace("{l}", "15");
-    item.replace("{v}", _sta_static_dns1.toString());
+const char *AsyncWiFiManager::optionsElement(AsyncWiFiManagerPortalMode mode)
+{
+  return mode == WM_MODE_AP ? _customOptionsElement : "";
+}
 
-    page += item;
+// handle root or redirect to captive portal
+void AsyncWiFiManager::handleRoot(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
+{
+  WM_LOGV(F("Handle root"));
+  WM_LOGV("Got request " + request->url());
 
-    item = FPSTR(HTTP_FORM_PARAM);
-    item.replace("{i}", "dns2");
-    item.replace("{n}", "dns2");
-    item.replace("{p}", "DNS2");
-    item.replace("{l}", "15");
-    item.replace("{v}", _sta_static_dns2.toString());
+  if (mode == WM_MODE_AP)
+  {
+    // AJS - maybe we should set a scan when we get to the root???
+    // and only scan on demand? timer + on demand? plus a link to make it happen?
+    requestPageScan();
 
-    page += item;
-    page += "<br/>";
+    if (captivePortal(request))
+    {
+      // if captive portal redirect instead of displaying the page
+      return;
+    }
+    WM_LOGV(F("Sending Captive Portal"));
   }
-  page += FPSTR(HTTP_FORM_END);
-  page += FPSTR(HTTP_SCAN_LINK);
-  page += FPSTR(HTTP_END);
 
-  request->send(200, "text/html", page);
+#if WM_FEATURE_STAND_ALONE
+  boolean standAlone = getStandAlone();
+#endif
+  AsyncWebServerResponse *response = beginPageResponse(request, [=](Print &out)
+  {
+    renderHead(out, "Options", headElement(mode));
+    if (mode == WM_MODE_AP)
+    {
+      out.print(F("<h1>"));
+      out.print(_apName);
+      out.print(F("</h1>"));
+    }
+    out.print(F("<h3><center>Xenia WiFi Manager</center></h3>"));
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS));
+#if WM_FEATURE_INFO
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS_INFO));
+#endif
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS_RESET));
+#if WM_FEATURE_STAND_ALONE
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS_STAND_ALONE));
+#endif
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS_HOME_START));
+    // the application's home page is /wifi behind the portal and / on its own network
+    out.print(mode == WM_MODE_AP ? F("/wifi") : F("/"));
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS_HOME));
+#if WM_FEATURE_STAND_ALONE
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS_STATE));
+    out.print(standAlone ? F("<p style=\"color:green;\">ACTIVATED</p>") : F("<p style=\"color:red;\">DEACTIVATED</p>"));
+    out.print(FPSTR(HTTP_PORTAL_OPTIONS2));
+#endif
+    out.print(optionsElement(mode));
+    out.print(FPSTR(HTTP_END));
+  });
+  response->addHeader("Cache-control","no-cache	");
+  request->send(response);
 
-  DEBUG_WM(F("Sent config page"));
+  WM_LOGV(F("Sent..."));
 }
 
 // wifi config page handler
-void AsyncWiFiManager::handleWifiSTA(AsyncWebServerRequest *request, boolean scan)
+void AsyncWiFiManager::handleWifi(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
 {
-  String page = FPSTR(WFM_HTTP_HEAD);
-
-  page.replace("{v}", "Config ESP");
-  Serial.printf("Got request %s\r\n", request->url().c_str());
+  WM_LOGV(F("Handle wifi"));
+  WM_LOGV("Got request " + request->url());
 
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  //page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-
-  WiFiResult *wifiSSIDs2;
-  wifi_ssid_count_t n = WiFi.scanNetworks(false);
-
-  if (n == WIFI_SCAN_FAILED)
+  if (mode == WM_MODE_AP)
   {
-    DEBUG_WM(F("scanNetworks returned: WIFI_SCAN_FAILED!"));
+    requestPageScan();
   }
-  else if (n == WIFI_SCAN_RUNNING)
+#if WM_FEATURE_STA_API
+  else
   {
-    DEBUG_WM(F("scanNetworks returned: WIFI_SCAN_RUNNING!"));
+    // no portal loop schedules scans here: answer from the last scan right
+    // away, refresh it in the background when it is too old
+    finishScan();
+    AsyncWiFiManagerScanSnapshot last(&_scanPool);
+    if (!last.published() || millis() - last.publishedAt() >= _scanCacheTTL)
+    {
+      startScan();
+    }
   }
-  else if (n < 0)
+#endif
+
+  if (wantsJson(request))
   {
-    DEBUG_WM(F("scanNetworks failed with unknown error code!"));
+    sendScanJson(request);
+    return;
   }
-  else if (n == 0)
+
+  std::shared_ptr<AsyncWiFiManagerScanSnapshot> snapshot(new AsyncWiFiManagerScanSnapshot(&_scanPool));
+  // custom parameters and static IP fields are only offered behind the
+  // portal, the api calls only take network credentials. Their block is
+  // rendered once here, a save or addParameter() while the page is going
+  // out would otherwise show up in the middle of it
+  std::shared_ptr<String> params(new String(mode == WM_MODE_AP ? paramsAsString() : String()));
+  request->send(beginScanResponse(request, *snapshot, [this, snapshot, params, mode](Print &out)
   {
-    DEBUG_WM(F("No networks found"));
-    // page += F("No networks found. Refresh to scan again.");
+    renderConfigPage(out, *snapshot, *params, mode);
+  }));
+
+  WM_LOGV(F("Sent config page"));
+}
+
+void AsyncWiFiManager::renderConfigPage(Print &out, AsyncWiFiManagerScanSnapshot &snapshot, const String &params, AsyncWiFiManagerPortalMode mode)
+{
+  renderHead(out, "Config ESP", headElement(mode));
+
+  // the script keeps the list in here live
+  out.print(F("<div id='n'>"));
+  if (snapshot.count() == 0)
+  {
+    out.print(snapshot.published() ? F("No networks found. Refresh to scan again") : F("Scanning..."));
   }
   else
   {
-    DEBUG_WM(F("Scan done"));
+    renderNetworkList(out, snapshot);
   }
+  out.print(F("</div><br/>"));
+
+  out.print(FPSTR(HTTP_FORM_START));
+  out.print(params);
+  out.print(FPSTR(HTTP_FORM_END));
+  out.print(FPSTR(HTTP_SCAN_LINK));
+  out.print(FPSTR(HTTP_END));
+}
+
+String AsyncWiFiManager::paramsAsString()
+{
+  String params;
+  StringPrint out(params);
+  renderParams(out);
+  return params;
+}
 
-  if (n > 0)
+void AsyncWiFiManager::renderParams(Print &out)
+{
+  char parLength[11];
+
+  // add the extra parameters to the form
+  for (size_t i = 0; i < _params.size(); i++)
   {
-    // WE SHOULD MOVE THIS IN PLACE ATOMICALLY
-    if (wifiSSIDs2)
+    if (_params[i]->getID() != NULL)
     {
-      delete[] wifiSSIDs2;
+      snprintf(parLength, sizeof(parLength), "%u", _params[i]->getValueLength());
+      const char *values[] = {_params[i]->getID(),
+                              _params[i]->getID(),
+                              _params[i]->getPlaceholder(),
+                              parLength,
+                              _params[i]->getValue(),
+                              _params[i]->getCustomHTML()};
+      paramTemplate.render(out, values);
     }
-    wifiSSIDs2 = new WiFiResult[n];
-    wifiSSIDCount = n;
-
-    for (wifi_ssid_count_t i = 0; i < n; i++)
+    else
     {
-      wifiSSIDs2[i].duplicate = false;
-
-      WiFi.getNetworkInfo(i,
-                          wifiSSIDs2[i].SSID,
-                          wifiSSIDs2[i].encryptionType,
-                          wifiSSIDs2[i].RSSI,
-                          wifiSSIDs2[i].BSSID,
-                          wifiSSIDs2[i].channel);
+      out.print(_params[i]->getCustomHTML());
     }
+  }
+  if (!_params.empty())
+  {
+    out.print(F("<br/>"));
+  }
+#if WM_FEATURE_STATIC_IP
+  if (_sta_static_ip)
+  {
+    renderIPParam(out, "ip", "Static IP", _sta_static_ip);
+    renderIPParam(out, "gw", "Static Gateway", _sta_static_gw);
+    renderIPParam(out, "sn", "Subnet", _sta_static_sn);
+    renderIPParam(out, "dns1", "DNS1", _sta_static_dns1);
+    renderIPParam(out, "dns2", "DNS2", _sta_static_dns2);
+    out.print(F("<br/>"));
+  }
+#endif
+}
 
-    // RSSI SORT
+// handle the WLAN save form and redirect to WLAN config page again
+void AsyncWiFiManager::handleWifiSave(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
+{
+  WM_LOGV(F("WiFi save"));
+  WM_LOGV("Got request " + request->url());
 
-    // old sort
-    for (int i = 0; i < n; i++)
-    {
-      for (int j = i + 1; j < n; j++)
-      {
-        if (wifiSSIDs2[j].RSSI > wifiSSIDs2[i].RSSI)
-        {
-          std::swap(wifiSSIDs2[i], wifiSSIDs2[j]);
-        }
-      }
-    }
+#if WM_FEATURE_STAND_ALONE
+  setStandAlone(false);
+#endif
+  // new credentials, the cached BSSID belongs to the old ones
+  forgetFastReconnect();
+
+  // SAVE/connect here
+  needInfo = true;
+  const String &ssid = request->arg("s");
+  const String &pass = request->arg("p");
+  addNetwork(ssid.c_str(), pass.c_str());
+
+  if (mode == WM_MODE_AP)
+  {
+    AsyncWiFiManagerConnectJob job;
+    strncpy(job.ssid, ssid.c_str(), sizeof(job.ssid) - 1);
+    job.ssid[sizeof(job.ssid) - 1] = '\0';
+    strncpy(job.pass, pass.c_str(), sizeof(job.pass) - 1);
+    job.pass[sizeof(job.pass) - 1] = '\0';
+#if WM_FEATURE_STATIC_IP
+    parseStaticIP(request, &job);
+#endif
+    // the values go straight into the parameters' own buffers
+    saveParams(request);
+    publishConnectJob(job); // signal ready to connect/reset
   }
 
-  String pager;
-  if (wifiSSIDCount == 0)
+  if (wantsJson(request))
   {
-    DEBUG_WM(F("No networks found"));
-    page += F("No networks found. Refresh to scan again");
+    sendSavedJson(request, ssid);
   }
   else
   {
-    // display networks in page
-
-    for (int i = 0; i < n; i++)
+    sendPage(request, [this, mode](Print &out)
     {
-      if (wifiSSIDs2[i].duplicate == true)
-      {
-        continue; // skip dups
-      }
-
-      unsigned int quality = getRSSIasQuality(wifiSSIDs2[i].RSSI);
-      String item = FPSTR(HTTP_ITEM);
-      String rssiQ;
-      rssiQ += quality;
-      item.replace("{v}", wifiSSIDs2[i].SSID);
-      item.replace("{r}", rssiQ);
-      if (wifiSSIDs2[i].encryptionType != WIFI_AUTH_OPEN)
-      {
-        item.replace("{i}", "l");
-      }
-      else
-      {
-        item.replace("{i}", "");
-      }
-      pager += item;
-
-    }
-
-    page += pager;
-    page += "<br/>";
+      // with the script the page follows the attempt over the events stream
+#if WM_FEATURE_INFO
+      renderHead(out, "Credentials Saved", headElement(mode),
+                 F("<noscript><meta http-equiv=\"refresh\" content=\"7; url=/api/v2/wifi/info\"></noscript>"));
+      out.print(FPSTR(HTTP_SAVED));
+      out.print(F("<div id='w' data-next='/api/v2/wifi/info'></div>"));
+#else
+      renderHead(out, "Credentials Saved", headElement(mode));
+      out.print(FPSTR(HTTP_SAVED));
+      out.print(F("<div id='w'></div>"));
+#endif
+      out.print(FPSTR(HTTP_END));
+    });
   }
 
+  WM_LOGV(F("Sent wifi save page"));
 
+  save_attempted = 1;
 
-  page += FPSTR(HTTP_FORM_START);
-  char parLength[2];
+#if WM_FEATURE_STA_API
+  if (mode == WM_MODE_AP)
+  {
+    return;
+  }
+  // switching networks drops the link this page goes out on, so start once the
+  // client has its answer instead of sleeping in the handler
+  request->onDisconnect([this, ssid, pass]()
+  {
+    DEBUG_WM(F("Connecting to new AP"));
+    WiFi.persistent(true);
+    beginConnect(ssid, pass, false);
+    WiFi.persistent(false);
+  });
+#endif
+}
 
+#if WM_FEATURE_STATIC_IP
+// form fields of the static config, in the order of the job's staticIP
+static const char *const WM_STATIC_IP_ARGS[WIFI_MANAGER_STATIC_IP_FIELDS] = {"ip", "gw", "sn", "dns1", "dns2"};
 
-  // add the extra parameters to the form
- /* for (unsigned int i = 0; i < _paramsCount; i++)
+void AsyncWiFiManager::parseStaticIP(AsyncWebServerRequest *request, AsyncWiFiManagerConnectJob *job)
+{
+  job->staticFields = 0;
+  for (uint8_t i = 0; i < WIFI_MANAGER_STATIC_IP_FIELDS; i++)
   {
-    if (_params[i] == NULL)
-    {
-      break;
-    }
-
-    String pitem = FPSTR(HTTP_FORM_PARAM);
-    if (_params[i]->getID() != NULL)
-    {
-      pitem.replace("{i}", _params[i]->getID());
-      pitem.replace("{n}", _params[i]->getID());
-      pitem.replace("{p}", _params[i]->getPlaceholder());
-      snprintf(parLength, 2, "%d", _params[i]->getValueLength());
-      pitem.replace("{l}", parLength);
-      pitem.replace("{v}", _params[i]->getValue());
-      pitem.replace("{c}", _params[i]->getCustomHTML());
-    }
-    else
+    if (request->hasArg(WM_STATIC_IP_ARGS[i]) &&
+        optionalIPFromString(&job->staticIP[i], request->arg(WM_STATIC_IP_ARGS[i]).c_str()))
     {
-      pitem = _params[i]->getCustomHTML();
+      job->staticFields |= 1 << i;
     }
+  }
+}
+#endif
 
-    page += pitem;
-  }*/
-
+void AsyncWiFiManager::publishConnectJob(const AsyncWiFiManagerConnectJob &job)
+{
+  _connectJobSeq++; // odd, the loop keeps off
+  _connectJob = job;
+  _connectJobSeq++;
+  wake();
+}
 
-  /*if (_params[0] != NULL)
+boolean AsyncWiFiManager::takeConnectJob(AsyncWiFiManagerConnectJob *job)
+{
+  uint32_t seq = _connectJobSeq;
+  if ((seq & 1) != 0 || seq == _connectJobTaken)
   {
-    page += "<br/>";
-  }*/
-
-  page += FPSTR(HTTP_FORM_END);
-  page += FPSTR(HTTP_SCAN_LINK);
-  page += FPSTR(HTTP_END);
-
-  request->send(200, "text/html", page);
-
-  DEBUG_WM(F("Sent config page"));
+    return false; // being written, or nothing new
+  }
+  *job = _connectJob;
+  if (_connectJobSeq != seq)
+  {
+    return false; // rewritten during the copy, the next pass takes the new one
+  }
+  _connectJobTaken = seq;
+  return true;
 }
 
-// handle the WLAN save form and redirect to WLAN config page again
-void AsyncWiFiManager::handleWifiSave(AsyncWebServerRequest *request)
+boolean AsyncWiFiManager::connectJobPending()
 {
-  DEBUG_WM(F("WiFi save"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  NVS.setInt(NVS_STAND_ALONE, 0, true);
+  return _connectJobSeq != _connectJobTaken;
+}
 
-  // SAVE/connect here
-  needInfo = true;
-  _ssid = request->arg("s").c_str();
-  _pass = request->arg("p").c_str();
+void AsyncWiFiManager::dropConnectJob()
+{
+  // a job still being written is taken once it is complete
+  _connectJobTaken = _connectJobSeq & ~1u;
+}
 
-  // parameters
-  for (unsigned int i = 0; i < _paramsCount; i++)
+void AsyncWiFiManager::applyConnectJob(const AsyncWiFiManagerConnectJob &job)
+{
+  _ssid = job.ssid;
+  _pass = job.pass;
+#if WM_FEATURE_STATIC_IP
+  IPAddress *targets[WIFI_MANAGER_STATIC_IP_FIELDS] = {&_sta_static_ip, &_sta_static_gw, &_sta_static_sn,
+                                                       &_sta_static_dns1, &_sta_static_dns2};
+  for (uint8_t i = 0; i < WIFI_MANAGER_STATIC_IP_FIELDS; i++)
   {
-    if (_params[i] == NULL)
+    if (job.staticFields & (1 << i))
     {
-      break;
+      WM_LOGV(F("static config"));
+      WM_LOGV(WM_STATIC_IP_ARGS[i]);
+      WM_LOGV(job.staticIP[i]);
+      *targets[i] = job.staticIP[i];
     }
-    // read parameter
-    String value = request->arg(_params[i]->getID()).c_str();
-    // store it in array
-    value.toCharArray(_params[i]->_value, _params[i]->_length);
-
-    DEBUG_WM(F("Parameter"));
-    DEBUG_WM(_params[i]->getID());
-    DEBUG_WM(value);
   }
+#endif
+}
+
+#if WM_FEATURE_INFO
+// handle the info page
+String AsyncWiFiManager::infoAsString()
+{
+  String page;
+  StringPrint out(page);
+  renderInfo(out, liveInfo());
+  return page;
+}
 
-  if (request->hasArg("ip"))
+String AsyncWiFiManager::infoAsJson()
+{
+  String json;
+  StringPrint out(json);
+  AsyncWiFiManagerJsonWriter writer(out);
+  renderInfo(out, liveInfo(), &writer);
+  return json;
+}
+
+void AsyncWiFiManager::renderInfo(Print &out, const AsyncWiFiManagerLiveInfo &live, AsyncWiFiManagerJsonWriter *json)
+{
+  loadStaticInfo();
+  const AsyncWiFiManagerStaticInfo &chip = _staticInfo;
+  InfoWriter info(out, json);
+  if (json != NULL)
   {
-    DEBUG_WM(F("static ip"));
-    DEBUG_WM(request->arg("ip"));
-    //_sta_static_ip.fromString(request->arg("ip"));
-    String ip = request->arg("ip");
-    optionalIPFromString(&_sta_static_ip, ip.c_str());
+    json->beginObject();
   }
-  if (request->hasArg("gw"))
+#if defined(ESP8266)
+  info.field("chipId", F("Chip ID"), chip.chipId);
+  info.field("flashChipId", F("Flash Chip ID"), chip.flashChipId);
+#else
+  info.field("chipId", F("Chip ID"), chip.chipId);
+  info.missing("flashChipId", F("Flash Chip ID"), F("N/A for ESP32"));
+#endif
+  info.field("flashSize", F("IDE Flash Size"), chip.flashSize, F(" bytes"));
+#if defined(ESP8266)
+  info.field("realFlashSize", F("Real Flash Size"), chip.realFlashSize, F(" bytes"));
+#else
+  info.missing("realFlashSize", F("Real Flash Size"), F("N/A for ESP32"));
+#endif
+  info.field("softAPIP", F("Soft AP IP"), live.softAPIP);
+  info.field("softAPMac", F("Soft AP MAC"), chip.softAPMac);
+  info.field("ssid", F("Station SSID"), live.ssid);
+  info.field("ip", F("Station IP"), live.ip);
+  info.field("rssi", F("Station RSSI"), (int)live.rssi, F(" dBm"));
+  info.field("mac", F("Station MAC"), chip.mac);
+  boolean connected = live.status == WL_CONNECTED;
+  if (json != NULL)
   {
-    DEBUG_WM(F("static gateway"));
-    DEBUG_WM(request->arg("gw"));
-    String gw = request->arg("gw");
-    optionalIPFromString(&_sta_static_gw, gw.c_str());
+    json->key("saveAttempted");
+    json->value(save_attempted != 0);
+    json->key("connected");
+    json->value(connected);
+    json->endObject();
+    return;
   }
-  if (request->hasArg("sn"))
+  out.print(F("</dl>"));
+  if (save_attempted)
   {
-    DEBUG_WM(F("static netmask"));
-    DEBUG_WM(request->arg("sn"));
-    String sn = request->arg("sn");
-    optionalIPFromString(&_sta_static_sn, sn.c_str());
+    out.print(F("</div><br><div style=text-align:center;display:inline-block;min-width:400px><dl><dt>"));
+    if (connected)
+    {
+      out.print(F("Connect now to your network "));
+      out.print(live.ssid);
+      out.print(F(" to get access to your machine by using the IPAddress: "));
+      out.print(live.ip);
+    }
+    else
+    { 
+      out.print(F("Connection failed to the network (wrong password, connection lost…)."));
+    }
+    out.print(F("</dl>"));
   }
-  if (request->hasArg("dns1"))
+}
+
+void AsyncWiFiManager::handleInfo(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
+{
+  WM_LOGV(F("Info"));
+  WM_LOGV("Got request " + request->url());
+
+  // behind the portal the loop and the connect events keep the live info
+  // current, the api calls read it fresh
+  boolean ap = mode == WM_MODE_AP;
+  boolean connecting = ap && connectJobPending();
+  if (!ap)
   {
-    DEBUG_WM(F("static DNS 1"));
-    DEBUG_WM(request->arg("dns1"));
-    String dns1 = request->arg("dns1");
-    optionalIPFromString(&_sta_static_dns1, dns1.c_str());
+    refreshLiveInfo();
   }
-  if (request->hasArg("dns2"))
+  AsyncWiFiManagerLiveInfo live = liveInfo();
+  if (wantsJson(request))
   {
-    DEBUG_WM(F("static DNS 2"));
-    DEBUG_WM(request->arg("dns2"));
-    String dns2 = request->arg("dns2");
-    optionalIPFromString(&_sta_static_dns2, dns2.c_str());
+    // one shape in both modes, connecting stays false on the api calls
+    sendPage(request, [this, live, connecting](Print &out)
+    {
+      AsyncWiFiManagerJsonWriter json(out);
+      json.beginObject();
+      json.key("connecting");
+      json.value(connecting);
+      json.key("status");
+      json.value((int)live.status);
+      json.key("info");
+      renderInfo(out, live, &json);
+      json.endObject();
+    }, "application/json");
+    return;
   }
+  sendPage(request, [this, live, connecting, mode](Print &out)
+  {
+    renderHead(out, "Info", headElement(mode),
+               connecting ? F("<noscript><meta http-equiv=\"refresh\" content=\"7; url=/api/v2/wifi/info\"></noscript>") : NULL);
+    out.print(F("<dl>"));
+    if (connecting)
+    {
+      out.print(F("<dt>Trying to connect</dt><dd id='w' data-next='/api/v2/wifi/info'>"));
+      out.print(live.status);
+      out.print(F("</dd>"));
+    }
+    renderInfo(out, live);
+    out.print(FPSTR(HTTP_END));
+  });
 
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Credentials Saved");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += _customHeadElement;
-  page += F("<meta http-equiv=\"refresh\" content=\"7; url=/api/v2/wifi/info\">");
-  page += FPSTR(HTTP_HEAD_END);
-  page += FPSTR(HTTP_SAVED);
-  page += FPSTR(HTTP_END);
-
-  request->send(200, "text/html", page);
-
-  DEBUG_WM(F("Sent wifi save page"));
-
-  connect = true; // signal ready to connect/reset
-
-  save_attempted = 1;
+  WM_LOGV(F("Sent info page"));
 }
+#endif
 
-// handle the WLAN save form and redirect to WLAN config page again
-void AsyncWiFiManager::handleWifiSaveSTA(AsyncWebServerRequest *request)
+// handle the reset page
+void AsyncWiFiManager::handleReset(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
 {
-  DEBUG_WM(F("WiFi save"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  NVS.setInt(NVS_STAND_ALONE, 0, true);
+  WM_LOGV(F("Reset"));
+  WM_LOGV("Got request " + request->url());
 
-  // SAVE/connect here
-  needInfo = true;
-  String _ssid2 = request->arg("s").c_str();
-  String _pass2 = request->arg("p").c_str();
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Credentials Saved");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += F("<meta http-equiv=\"refresh\" content=\"7; url=/api/v2/wifi/info\">");
-  page += FPSTR(HTTP_HEAD_END);
-  page += FPSTR(HTTP_SAVED);
-  page += FPSTR(HTTP_END);
-
-  request->send(200, "text/html", page);
+  sendPage(request, [this, mode](Print &out)
+  {
+    renderHead(out, "Info", headElement(mode));
+    out.print(F("Module will reset in a few seconds"));
+    out.print(FPSTR(HTTP_END));
+  });
 
-  save_attempted = 1;
+  WM_LOGV(F("Sent reset page"));
+  deferAction(request, WM_ACTION_RESTART);
+}
 
-  DEBUG_WM(F("Sent wifi save page"));
+#if WM_FEATURE_STAND_ALONE
+// handle the stand alone page
+void AsyncWiFiManager::handleStandAlone(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
+{
+  WM_LOGV(F("Stand alone"));
+  WM_LOGV("Got request " + request->url());
 
-  delay(2000);
+  if (wantsJson(request))
+  {
+    sendStandAloneJson(request);
+    return;
+  }
 
-  WiFi.persistent(true);
-  
-  WiFi.disconnect(false);
-  WiFi.begin(_ssid2.c_str(), _pass2.c_str());
+  sendPage(request, [this, mode](Print &out)
+  {
+    renderHead(out, "Stand alone", headElement(mode));
+    out.print(F("<h3><center>Are you sure you want to activate stand alone mode ?</center></h3>"));
+    out.print(FPSTR(HTTP_STAND_ALONE_OPTIONS));
+    out.print(optionsElement(mode));
+    out.print(FPSTR(HTTP_END));
+  });
 
-  WiFi.persistent(false);
-  // connected
-  //DEBUG_WM(F("Setting sta mode"));
-  //WiFi.mode(WIFI_STA);
+  WM_LOGV(F("Sent stand alone page"));
+}
 
-  DEBUG_WM(F("Connected to wifi"));
-  Serial.println(WiFi.SSID());
-  DEBUG_WM(F("IP"));
-  Serial.println(WiFi.localIP().toString());
+void AsyncWiFiManager::handleStandAloneYes(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
+{
+  setStandAlone(true);
+  String page = "Search and connect to the network of the machine and open the webinterface: 192.168.10.101";
+  request->send(200, "text/html", page);
+  deferAction(request, WM_ACTION_ERASE_RESTART);
+}
 
-  delay(200);
+void AsyncWiFiManager::handleStandAloneNo(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
+{
+  setStandAlone(false);
+  String page = "Standalone mode is deactivated. Connect again to the network of the machine and connect the machine to the local wifi.";
+  request->send(200, "text/html", page);
+  deferAction(request, WM_ACTION_RESTART);
+}
+#endif
 
-  //ESP.restart();
+// Handlers only queue the restart, waiting there would block async_tcp and
+// the response would usually never leave. The loop runs it once the client
+// closed the connection, or WIFI_MANAGER_ACTION_DELAY ms at the latest.
+void AsyncWiFiManager::deferAction(AsyncWebServerRequest *request, AsyncWiFiManagerAction action)
+{
+  _pendingActionAt = millis() + WIFI_MANAGER_ACTION_DELAY;
+  _pendingAction = action;
+  wakeIn(WIFI_MANAGER_ACTION_DELAY);
+  request->onDisconnect([this]()
+  {
+    // the response is out
+    _pendingActionAt = millis();
+    wake();
+  });
 }
 
-// handle the info page
-String AsyncWiFiManager::infoAsString()
+void AsyncWiFiManager::runPendingAction()
 {
-  String page;
-  page += F("<dt>Chip ID</dt><dd>");
+  uint8_t action = _pendingAction;
+  if (action == WM_ACTION_NONE || (long)(millis() - _pendingActionAt) < 0)
+  {
+    return;
+  }
+  if (!_pendingAction.compare_exchange_strong(action, WM_ACTION_NONE))
+  {
+    return; // criticalLoop() and the portal loop may both get here
+  }
+  if (action == WM_ACTION_ERASE_RESTART)
+  {
+    WiFi.mode(WIFI_AP_STA); // cannot erase if not in STA mode !
+    WiFi.persistent(true);
 #if defined(ESP8266)
-  page += ESP.getChipId();
+    WiFi.disconnect(true);
 #else
-  page += getESP32ChipID();
+    WiFi.disconnect(true, true);
 #endif
-  page += F("</dd>");
-  page += F("<dt>Flash Chip ID</dt><dd>");
+    WiFi.persistent(false);
+  }
+  flushSettings();
+  WM_LOGI(F("Restarting"));
 #if defined(ESP8266)
-  page += ESP.getFlashChipId();
+  ESP.reset();
 #else
-  page += F("N/A for ESP32");
+  ESP.restart();
 #endif
-  page += F("</dd>");
-  page += F("<dt>IDE Flash Size</dt><dd>");
-  page += ESP.getFlashChipSize();
-  page += F(" bytes</dd>");
-  page += F("<dt>Real Flash Size</dt><dd>");
-#if defined(ESP8266)
-  page += ESP.getFlashChipRealSize();
-#else
-  page += F("N/A for ESP32");
-#endif
-  page += F(" bytes</dd>");
-  page += F("<dt>Soft AP IP</dt><dd>");
-  page += WiFi.softAPIP().toString();
-  page += F("</dd>");
-  page += F("<dt>Soft AP MAC</dt><dd>");
-  page += WiFi.softAPmacAddress();
-  page += F("</dd>");
-  page += F("<dt>Station SSID</dt><dd>");
-  page += WiFi.SSID();
-  page += F("</dd>");
-  page += F("<dt>Station IP</dt><dd>");
-  page += WiFi.localIP().toString();
-  page += F("</dd>");
-  page += F("<dt>Station MAC</dt><dd>");
-  page += WiFi.macAddress();
-  page += F("</dd>");
-  page += F("</dl>");   
-  if (save_attempted)
+}
+
+#if !defined(ESP8266)
+// esp_timer task: flash commits, WiFi teardown and restarts do not belong
+// here, only wake the loop
+void AsyncWiFiManager::serviceTimer(void *arg)
+{
+  AsyncWiFiManager *self = static_cast<AsyncWiFiManager *>(arg);
+  self->wake();
+  // a deadline moved, come back when the next one is due
+  long next = LONG_MAX;
+  long settingsLeft = (long)(self->_settingsChanged + WIFI_MANAGER_SETTINGS_FLUSH_DELAY - millis());
+  if (self->_settingsDirty != 0 && settingsLeft > 0)
   {
-    page += F("</div><br><div style=text-align:center;display:inline-block;min-width:400px><dl><dt>");
-    if (WiFi.status() == WL_CONNECTED)
-    {
-      page += F("Connect now to your network ");
-      page += WiFi.SSID();
-      page += F(" to get access to your machine by using the IPAddress: ");
-      page += WiFi.localIP().toString();
-    }
-    else
-    { 
-      page += F("Connection failed to the network (wrong password, connection lost…).");
-    }
-    page += F("</dl>");
+    next = settingsLeft;
+  }
+  long actionLeft = (long)(self->_pendingActionAt - millis());
+  if (self->_pendingAction != WM_ACTION_NONE && actionLeft > 0)
+  {
+    next = std::min(next, actionLeft);
+  }
+  if (next != LONG_MAX)
+  {
+    self->_serviceTimer.once(next);
   }
+}
+#endif
 
-  return page;
+#if !defined(ESP8266)
+void AsyncWiFiManager::setPortalTask(boolean enable, BaseType_t core, UBaseType_t priority, uint32_t stackSize)
+{
+  _portalTaskEnabled = enable;
+  _portalTaskCore = core;
+  _portalTaskPriority = priority;
+  _portalTaskStack = stackSize;
+  if (!enable)
+  {
+    stopPortalTask();
+  }
 }
 
-void AsyncWiFiManager::handleInfo(AsyncWebServerRequest *request)
+void AsyncWiFiManager::portalTask(void *arg)
 {
-  DEBUG_WM(F("Info"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
+  AsyncWiFiManager *wm = (AsyncWiFiManager *)arg;
+  wm->_loopTask = xTaskGetCurrentTaskHandle();
+  while (!wm->_portalTaskStop)
+  {
+    wm->safeLoop();
+    wm->criticalLoop();
+    wm->waitForWork();
+  }
+  wm->_loopTask = NULL;
+  wm->_portalTask = NULL;
+  vTaskDelete(NULL);
+}
 
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Info");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += _customHeadElement;
-  if (connect == true)
+void AsyncWiFiManager::startPortalTask()
+{
+  if (!_portalTaskEnabled || _portalTask != NULL)
   {
-    page += F("<meta http-equiv=\"refresh\" content=\"7; url=/api/v2/wifi/info\">");
+    return;
   }
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("<dl>");
-  if (connect == true)
+  TaskHandle_t task = NULL;
+  if (xTaskCreatePinnedToCore(portalTask, "wm_portal", _portalTaskStack, this, _portalTaskPriority, &task,
+                              _portalTaskCore) != pdPASS)
   {
-    page += F("<dt>Trying to connect</dt><dd>");
-    page += wifiStatus;
-    page += F("</dd>");
+    WM_LOGE(F("Portal task not started, loop() has to be called"));
+    return;
   }
-  page += pager;
-  page += FPSTR(HTTP_END);
-
-  request->send(200, "text/html", page);
-
-  DEBUG_WM(F("Sent info page"));
+  _portalTask = task;
 }
+#endif
 
-void AsyncWiFiManager::handleInfoSTA(AsyncWebServerRequest *request)
+void AsyncWiFiManager::stopPortalTask()
 {
-  DEBUG_WM(F("Info"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Info");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  //page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("<dl>");
-
-  page += setInfoSTA();
-  page += FPSTR(HTTP_END);
-
-  request->send(200, "text/html", page);
-
-  DEBUG_WM(F("Sent info page"));
+#if !defined(ESP8266)
+  if (_portalTask == NULL || _portalTask == xTaskGetCurrentTaskHandle())
+  {
+    return;
+  }
+  _portalTaskStop = true;
+  wake();
+  while (_portalTask != NULL)
+  {
+    delay(10);
+  }
+  _portalTaskStop = false;
+#endif
 }
 
-// handle the reset page
-void AsyncWiFiManager::handleReset(AsyncWebServerRequest *request)
-{
-  DEBUG_WM(F("Reset"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Info");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("Module will reset in a few seconds");
-  page += FPSTR(HTTP_END);
-  request->send(200, "text/html", page);
-
-  DEBUG_WM(F("Sent reset page"));
-  delay(500);
+// with the portal task running only that task runs the loop
+boolean AsyncWiFiManager::ownsLoop()
+{
 #if defined(ESP8266)
-  ESP.reset();
+  return true;
 #else
-  ESP.restart();
+  TaskHandle_t task = _portalTask;
+  return task == NULL || task == xTaskGetCurrentTaskHandle();
 #endif
-  delay(200);
 }
 
-// handle the reset page
-void AsyncWiFiManager::handleResetSTA(AsyncWebServerRequest *request)
-{
-  DEBUG_WM(F("Reset"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Info");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  //page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("Module will reset in a few seconds");
-  page += FPSTR(HTTP_END);
-  request->send(200, "text/html", page);
+// there is work for the loop, called from handlers and WiFi events
+void AsyncWiFiManager::wake()
+{
+#if !defined(ESP8266)
+  TaskHandle_t task = _loopTask;
+  if (task != NULL)
+  {
+    xTaskNotifyGive(task);
+  }
+#endif
+}
+
+// wake() in ms, for a loop that would sleep past a deadline. The ESP8266 loop
+// never sleeps
+void AsyncWiFiManager::wakeIn(uint32_t ms)
+{
+#if !defined(ESP8266)
+  _serviceTimer.once(ms);
+#endif
+}
 
-  DEBUG_WM(F("Sent reset page"));
-  delay(500);
+void AsyncWiFiManager::waitForWork()
+{
 #if defined(ESP8266)
-  ESP.reset();
+  yield();
 #else
-  ESP.restart();
+  unsigned long wait = WIFI_MANAGER_LOOP_IDLE;
+  if (_powerSave && _stations == 0)
+  {
+    wait = WIFI_MANAGER_LOOP_POWER_SAVE; // no one to send DNS queries either
+  }
+#ifndef USE_EADNS
+  else if (!_builtinDNS)
+  {
+    wait = WIFI_MANAGER_DNS_POLL; // DNSServer only answers when polled
+  }
+#endif
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
 #endif
-  delay(200);
 }
 
-// handle the stand alone page
-void AsyncWiFiManager::handleStandAlone(AsyncWebServerRequest *request)
-{
-  DEBUG_WM(F("Stand alone"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
-
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Stand alone");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("<h3><center>Are you sure you want to activate stand alone mode ?</center></h3>");
-  page += FPSTR(HTTP_STAND_ALONE_OPTIONS);
-  page += _customOptionsElement;
-  page += FPSTR(HTTP_END);
-  request->send(200, "text/html", page);
+// serve a static asset, pages link to it with its ETag in the query string so
+// it can be cached for good
+void AsyncWiFiManager::handleAsset(AsyncWebServerRequest *request, const AsyncWiFiManagerAsset *asset)
+{
+  AsyncWebServerResponse *response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag)
+  {
+    response = request->beginResponse(304);
+  }
+  else
+  {
+    response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+    if (asset->gzipped)
+    {
+      response->addHeader("Content-Encoding", "gzip");
+    }
+#ifdef USE_WM_METRICS
+    if (_currentMetrics != NULL)
+    {
+      _currentMetrics->bytes += asset->length;
+    }
+#endif
+  }
+  response->addHeader("ETag", asset->etag);
+  response->addHeader("Cache-Control", "public, max-age=31536000, immutable");
+  request->send(response);
+}
 
-  DEBUG_WM(F("Sent stand alone page"));
+#ifdef USE_WM_METRICS
+uint8_t AsyncWiFiManager::getRouteMetrics(AsyncWiFiManagerRouteMetrics *metrics, uint8_t max)
+{
+  uint8_t count = std::min(_metricsCount, max);
+  memcpy(metrics, _metrics, count * sizeof(AsyncWiFiManagerRouteMetrics));
+  return _metricsCount;
 }
 
-void AsyncWiFiManager::handleStandAloneSTA(AsyncWebServerRequest *request)
+// Prometheus text exposition by default, JSON for ?format=json
+void AsyncWiFiManager::handleMetrics(AsyncWebServerRequest *request, AsyncWiFiManagerPortalMode mode)
 {
-  DEBUG_WM(F("Stand alone"));
-  Serial.printf("Got request %s\r\n", request->url().c_str());
+  // the counters keep moving while the response is streamed, render a copy
+  uint8_t count = _metricsCount;
+  std::shared_ptr<AsyncWiFiManagerRouteMetrics> metrics(new AsyncWiFiManagerRouteMetrics[count],
+                                                        std::default_delete<AsyncWiFiManagerRouteMetrics[]>());
+  memcpy(metrics.get(), _metrics, count * sizeof(AsyncWiFiManagerRouteMetrics));
+  boolean json = wantsJson(request);
+  sendPage(request, [this, metrics, count, json](Print &out)
+  {
+    renderMetrics(out, metrics.get(), count, json);
+  }, json ? "application/json" : "text/plain; version=0.0.4");
+}
 
-  String page = FPSTR(WFM_HTTP_HEAD);
-  page.replace("{v}", "Stand alone");
-  page += FPSTR(HTTP_SCRIPT);
-  page += FPSTR(HTTP_STYLE);
-  //page += _customHeadElement;
-  page += FPSTR(HTTP_HEAD_END);
-  page += F("<h3><center>Are you sure you want to activate stand alone mode ?</center></h3>");
-  page += FPSTR(HTTP_STAND_ALONE_OPTIONS_STA);
-  //page += _customOptionsElement;
-  page += FPSTR(HTTP_END);
-  request->send(200, "text/html", page);
+void AsyncWiFiManager::renderMetrics(Print &out, const AsyncWiFiManagerRouteMetrics *metrics,
+                                     uint8_t count, boolean json)
+{
+  if (json)
+  {
+    AsyncWiFiManagerJsonWriter writer(out);
+    writer.beginObject();
+    writer.key("latency_bounds_us");
+    writer.beginArray();
+    for (uint8_t b = 0; b < WIFI_MANAGER_LATENCY_BUCKETS - 1; b++)
+    {
+      writer.value((unsigned long)WM_LATENCY_BOUNDS[b]);
+    }
+    writer.endArray();
+    writer.key("routes");
+    writer.beginArray();
+    for (uint8_t i = 0; i < count; i++)
+    {
+      const AsyncWiFiManagerRouteMetrics &m = metrics[i];
+      writer.beginObject();
+      writer.key("route");
+      writer.value(m.route);
+      writer.key("requests");
+      writer.value((unsigned long)m.requests);
+      writer.key("bytes");
+      writer.value((unsigned long)m.bytes);
+      writer.key("latency_sum_us");
+      writer.raw(String((double)m.latencySum, 0));
+      writer.key("latency");
+      writer.beginArray();
+      for (uint8_t b = 0; b < WIFI_MANAGER_LATENCY_BUCKETS; b++)
+      {
+        writer.value((unsigned long)m.latency[b]);
+      }
+      writer.endArray();
+      writer.key("heap_before");
+      writer.value((unsigned long)m.heapBefore);
+      writer.key("heap_after");
+      writer.value((unsigned long)m.heapAfter);
+      writer.key("largest_block_after");
+      writer.value((unsigned long)m.largestBlockAfter);
+      writer.key("min_largest_block");
+      writer.value((unsigned long)(m.requests ? m.minLargestBlock : 0));
+      writer.key("rejected");
+      writer.value((unsigned long)m.rejected);
+      writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+    return;
+  }
 
-  DEBUG_WM(F("Sent stand alone page"));
+  out.print(F("# TYPE wm_requests_total counter\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_requests_total{route=\"%s\"} %u\n", metrics[i].route, metrics[i].requests);
+  }
+  out.print(F("# TYPE wm_rejected_total counter\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_rejected_total{route=\"%s\"} %u\n", metrics[i].route, metrics[i].rejected);
+  }
+  out.print(F("# TYPE wm_response_bytes_total counter\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_response_bytes_total{route=\"%s\"} %u\n", metrics[i].route, metrics[i].bytes);
+  }
+  out.print(F("# TYPE wm_handler_latency_us histogram\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const AsyncWiFiManagerRouteMetrics &m = metrics[i];
+    uint32_t cumulative = 0;
+    for (uint8_t b = 0; b < WIFI_MANAGER_LATENCY_BUCKETS; b++)
+    {
+      cumulative += m.latency[b];
+      if (b < WIFI_MANAGER_LATENCY_BUCKETS - 1)
+      {
+        out.printf("wm_handler_latency_us_bucket{route=\"%s\",le=\"%u\"} %u\n",
+                   m.route, WM_LATENCY_BOUNDS[b], cumulative);
+      }
+      else
+      {
+        out.printf("wm_handler_latency_us_bucket{route=\"%s\",le=\"+Inf\"} %u\n", m.route, cumulative);
+      }
+    }
+    out.printf("wm_handler_latency_us_sum{route=\"%s\"} ", m.route);
+    out.println((double)m.latencySum, 0);
+    out.printf("wm_handler_latency_us_count{route=\"%s\"} %u\n", m.route, m.requests);
+  }
+  out.print(F("# TYPE wm_heap_before_bytes gauge\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_heap_before_bytes{route=\"%s\"} %u\n", metrics[i].route, metrics[i].heapBefore);
+  }
+  out.print(F("# TYPE wm_heap_after_bytes gauge\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_heap_after_bytes{route=\"%s\"} %u\n", metrics[i].route, metrics[i].heapAfter);
+  }
+  out.print(F("# TYPE wm_largest_block_after_bytes gauge\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_largest_block_after_bytes{route=\"%s\"} %u\n", metrics[i].route, metrics[i].largestBlockAfter);
+  }
+  out.print(F("# TYPE wm_min_largest_block_bytes gauge\n"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    out.printf("wm_min_largest_block_bytes{route=\"%s\"} %u\n", metrics[i].route,
+               metrics[i].requests ? metrics[i].minLargestBlock : 0);
+  }
 }
+#endif
 
 void AsyncWiFiManager::handleNotFound(AsyncWebServerRequest *request)
 {
-  Serial.printf("Got request %s\r\n", request->url().c_str());
+  WM_LOGV("Got request " + request->url());
 
   //DEBUG_WM(F("Handle not found"));
   if (captivePortal(request))
@@ -1926,15 +4399,32 @@ boolean AsyncWiFiManager::captivePortal(AsyncWebServerRequest *request)
 {
   if (!isIp(request->host()))
   {
-    DEBUG_WM(F("Request redirected to captive portal"));
+    WM_LOGV(F("Request redirected to captive portal"));
     AsyncWebServerResponse *response = request->beginResponse(302, "text/plain", "");
-    response->addHeader("Location", String("http://") + toStringIp(request->client()->localIP()) + String("/wifi"));
+    IPAddress local = request->client()->localIP();
+    if (local == _portalIP)
+    {
+      response->addHeader("Location", _portalLocation);
+    }
+    else
+    {
+      response->addHeader("Location", String("http://") + toStringIp(local) + String("/wifi"));
+    }
     request->send(response);
     return true;
   }
   return false;
 }
 
+// connectivity checks come in bursts, answer them without any work
+void AsyncWiFiManager::handleProbe(AsyncWebServerRequest *request)
+{
+  AsyncWebServerResponse *response = request->beginResponse(302, "text/plain", "");
+  response->addHeader("Location", _portalLocation);
+  response->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+  request->send(response);
+}
+
 // start up config portal callback
 void AsyncWiFiManager::setAPCallback(std::function<void(AsyncWiFiManager *)> func)
 {
@@ -1962,17 +4452,55 @@ void AsyncWiFiManager::setCustomOptionsElement(const char *element)
 // if this is true, remove duplicated Access Points - defaut true
 void AsyncWiFiManager::setRemoveDuplicateAPs(boolean removeDuplicates)
 {
-  _removeDuplicateAPs = removeDuplicates;
+  _removeDuplicateAPs = removeDuplicates && WM_FEATURE_REMOVE_DUPLICATES;
 }
 
 template <typename Generic>
-void AsyncWiFiManager::DEBUG_WM(Generic text)
+void AsyncWiFiManager::logLine(Generic text)
+{
+  if (!_debug)
+  {
+    return;
+  }
+#if WM_LOG_BUFFER > 0 && !defined(ESP8266)
+  if (wmLogBuffer != NULL)
+  {
+    char line[WIFI_MANAGER_LOG_LINE];
+    AsyncWiFiManagerChunkPrint out((uint8_t *)line, sizeof(line), 0);
+    out.print(F("*WM: "));
+    out.print(text);
+    // never wait for room, a full buffer costs the line instead
+    if (xRingbufferSend(wmLogBuffer, line, out.length(), 0) != pdTRUE)
+    {
+      wmLogDropped++;
+    }
+    return;
+  }
+#endif
+  Serial.print(F("*WM: "));
+  Serial.println(text);
+}
+
+// lines logged before this go to Serial directly
+void AsyncWiFiManager::startLogSink()
 {
-  if (_debug)
+#if WM_LOG_BUFFER > 0 && !defined(ESP8266)
+  if (wmLogBuffer != NULL)
   {
-    Serial.print(F("*WM: "));
-    Serial.println(text);
+    return;
+  }
+  RingbufHandle_t buffer = xRingbufferCreate(WM_LOG_BUFFER, RINGBUF_TYPE_NOSPLIT);
+  if (buffer == NULL)
+  {
+    return;
   }
+  if (xTaskCreate(wmLogTask, "wm_log", 2048, buffer, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+  {
+    vRingbufferDelete(buffer);
+    return;
+  }
+  wmLogBuffer = buffer;
+#endif
 }
 
 unsigned int AsyncWiFiManager::getRSSIasQuality(int RSSI)
@@ -1995,12 +4523,11 @@ unsigned int AsyncWiFiManager::getRSSIasQuality(int RSSI)
 }
 
 // is this an IP?
-boolean AsyncWiFiManager::isIp(String str)
+boolean AsyncWiFiManager::isIp(const String &str)
 {
-  for (unsigned int i = 0; i < str.length(); i++)
+  for (const char *c = str.c_str(); *c != '\0'; c++)
   {
-    int c = str.charAt(i);
-    if (c != '.' && (c < '0' || c > '9'))
+    if (*c != '.' && (*c < '0' || *c > '9'))
     {
       return false;
     }
@@ -14,13 +14,19 @@
 #ifndef ESPAsyncWiFiManager_h
 #define ESPAsyncWiFiManager_h
 
+#include "ESPAsyncWiFiManagerConfig.h"
+
 #if defined(ESP8266)
 #include <ESP8266WiFi.h> // https://github.com/esp8266/Arduino
 #else
 #include <WiFi.h>
+#include <AsyncUDP.h>
+#include <freertos/event_groups.h>
+#if WM_FEATURE_WPS
 #include "esp_wps.h"
 #define ESP_WPS_MODE WPS_TYPE_PBC
 #endif
+#endif
 #include <ESPAsyncWebServer.h>
 
 //#define USE_EADNS               // uncomment to use ESPAsyncDNSServer
@@ -30,7 +36,10 @@
 #else
 #include <DNSServer.h>
 #endif
+//#define USE_WM_METRICS          // uncomment to count requests, latency and heap per route
 #include <memory>
+#include <atomic>
+#include <vector>
 
 // fix crash on ESP32 (see https://github.com/alanswx/ESPAsyncWiFiManager/issues/44)
 #if defined(ESP8266)
@@ -46,17 +55,30 @@ extern "C"
 }
 #else
 #include <rom/rtc.h>
+#include <esp_timer.h>
 #endif
 
 const char WFM_HTTP_HEAD[] PROGMEM = "<!DOCTYPE html><html lang=\"en\"><head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1, user-scalable=no\"/><title>{v}</title>";
-const char HTTP_STYLE[] PROGMEM = "<style>.c{text-align: center;} div,input{padding:5px;font-size:1em;} input{width:95%;} body{text-align: center;font-family:verdana;} button{border:0;border-radius:0.3rem;background-color:#1fa3ec;color:#fff;line-height:2.4rem;font-size:1.2rem;width:100%;} .q{float: right;width: 64px;text-align: right;} .l{background: url(\"data:image/png;base64,iVBORw0KGgoAAAANSUhEUgAAACAAAAAgCAMAAABEpIrGAAAALVBMVEX///8EBwfBwsLw8PAzNjaCg4NTVVUjJiZDRUUUFxdiZGSho6OSk5Pg4eFydHTCjaf3AAAAZElEQVQ4je2NSw7AIAhEBamKn97/uMXEGBvozkWb9C2Zx4xzWykBhFAeYp9gkLyZE0zIMno9n4g19hmdY39scwqVkOXaxph0ZCXQcqxSpgQpONa59wkRDOL93eAXvimwlbPbwwVAegLS1HGfZAAAAABJRU5ErkJggg==\") no-repeat left center;background-size: 1em;}</style>";
-const char HTTP_SCRIPT[] PROGMEM = "<script>function c(l){document.getElementById('s').value=l.innerText||l.textContent;document.getElementById('p').focus();}</script>";
+// the stylesheet, script and lock icon live in assets/ and are served gzipped
+// from flash, see tools/embed_assets.py
 const char HTTP_HEAD_END[] PROGMEM = "</head><body><div style='text-align:left;display:inline-block;min-width:260px;'>";
-const char HTTP_PORTAL_OPTIONS[] PROGMEM = "<form action=\"/api/v2/wifi/scan\" method=\"get\"><button>Configure WiFi</button></form><br/><form action=\"/api/v2/wifi/info\" method=\"get\"><button>Info</button></form><br/><form action=\"/api/v2/wifi/reset\" method=\"post\"><button>Reset</button></form><br/><form action=\"/api/v2/wifi/stand_alone\" method=\"get\"><button>Stand alone mode</button></form><br/><form action=\"/wifi\" method=\"post\"><button>Xenia home</button></form><h3><center>Stand alone mode: ";
-const char HTTP_PORTAL_OPTIONS_STA[] PROGMEM = "<form action=\"/api/v2/wifi/scan\" method=\"get\"><button>Configure WiFi</button></form><br/><form action=\"/api/v2/wifi/info\" method=\"get\"><button>Info</button></form><br/><form action=\"/api/v2/wifi/reset\" method=\"post\"><button>Reset</button></form><br/><form action=\"/api/v2/wifi/stand_alone\" method=\"get\"><button>Stand alone mode</button></form><br/><form action=\"/\" method=\"post\"><button>Xenia home</button></form><h3><center>Stand alone mode: ";
+const char HTTP_PORTAL_OPTIONS[] PROGMEM = "<form action=\"/api/v2/wifi/scan\" method=\"get\"><button>Configure WiFi</button></form><br/>";
+#if WM_FEATURE_INFO
+const char HTTP_PORTAL_OPTIONS_INFO[] PROGMEM = "<form action=\"/api/v2/wifi/info\" method=\"get\"><button>Info</button></form><br/>";
+#endif
+const char HTTP_PORTAL_OPTIONS_RESET[] PROGMEM = "<form action=\"/api/v2/wifi/reset\" method=\"post\"><button>Reset</button></form><br/>";
+#if WM_FEATURE_STAND_ALONE
+const char HTTP_PORTAL_OPTIONS_STAND_ALONE[] PROGMEM = "<form action=\"/api/v2/wifi/stand_alone\" method=\"get\"><button>Stand alone mode</button></form><br/>";
+#endif
+// the home button's url goes between these two
+const char HTTP_PORTAL_OPTIONS_HOME_START[] PROGMEM = "<form action=\"";
+const char HTTP_PORTAL_OPTIONS_HOME[] PROGMEM = "\" method=\"post\"><button>Xenia home</button></form>";
+#if WM_FEATURE_STAND_ALONE
+// the state goes between these two
+const char HTTP_PORTAL_OPTIONS_STATE[] PROGMEM = "<h3><center>Stand alone mode: ";
 const char HTTP_PORTAL_OPTIONS2[] PROGMEM = "</center></h3>";
 const char HTTP_STAND_ALONE_OPTIONS[] PROGMEM = "<form action=\"/api/v2/wifi/stand_alone_yes\" method=\"get\"><button>Activate</button></form><br/><form action=\"/api/v2/wifi/stand_alone_no\" method=\"get\"><button>Deactivate</button></form>";
-const char HTTP_STAND_ALONE_OPTIONS_STA[] PROGMEM = "<form action=\"/api/v2/wifi/stand_alone_yes\" method=\"get\"><button>Activate</button></form><br/><form action=\"/api/v2/wifi/stand_alone_no\" method=\"get\"><button>Deactivate</button></form>";
+#endif
 const char HTTP_ITEM[] PROGMEM = "<div><a href='#p' onclick='c(this)'>{v}</a>&nbsp;<span class='q {i}'>{r}%</span></div>";
 const char HTTP_FORM_START[] PROGMEM = "<form method='get' action='/api/v2/wifi/save'><input id='s' name='s' length=32 placeholder='SSID'><br/><input id='p' name='p' length=64 type='password' placeholder='password'><br/>";
 const char HTTP_FORM_PARAM[] PROGMEM = "<br/><input id='{i}' name='{n}' length={l} placeholder='{p}' value='{v}' {c}>";
@@ -65,7 +87,14 @@ const char HTTP_SCAN_LINK[] PROGMEM = "<br/><div class=\"c\"><a href=\"/api/v2/w
 const char HTTP_SAVED[] PROGMEM = "<div>Credentials Saved<br />Trying to connect ESP to network.<br />If it fails reconnect to AP to try again.<br /><br />If device connects successfully it will respond with it's new IP address.</div>";
 const char HTTP_END[] PROGMEM = "</div></body></html>";
 
-#define WIFI_MANAGER_MAX_PARAMS 10
+#define WIFI_MANAGER_MAX_TEMPLATE_SPANS 16
+#define WIFI_MANAGER_MAX_SCAN_INDEX 255 // scan results are indexed with uint8_t
+#define WIFI_MANAGER_SCAN_TIMEOUT 15000 // ms before a scan that never completes is given up
+#define WIFI_MANAGER_SCAN_INTERVAL 10000 // ms between scans of the modal portal with a station attached
+#define WIFI_MANAGER_MODELESS_SCAN_INTERVAL 60000 // the same for the modeless portal
+#ifndef WIFI_MANAGER_MAX_SCAN_RESULTS
+#define WIFI_MANAGER_MAX_SCAN_RESULTS 32 // networks kept per scan, two buffers of these are reserved
+#endif
 
 class AsyncWiFiManagerParameter
 {
@@ -90,9 +119,11 @@ public:
 private:
   const char *_id;
   const char *_placeholder;
+  // own buffer until the parameter is added, then a slot in the manager's value arena
   char *_value;
   unsigned int _length;
   const char *_customHTML;
+  boolean _inArena;
 
   void init(const char *id,
             const char *placeholder,
@@ -103,20 +134,459 @@ private:
   friend class AsyncWiFiManager;
 };
 
-class WiFiResult
+// one scan record, plain data so scans never touch the heap
+struct WiFiResult
+{
+  char SSID[33];
+  uint8_t BSSID[6];
+  int8_t RSSI;
+  uint8_t channel : 4;
+  uint8_t encryptionType : 4;
+  uint8_t isHidden : 1;
+};
+
+// Fixed, double buffered storage for scan results. A scan is written into the
+// back buffer and published by flipping the front index. Readers pin the front
+// buffer for as long as they render from it, a buffer that is still pinned is
+// never written, the scan that would have gone there is dropped instead.
+class AsyncWiFiManagerScanPool
 {
 public:
-  bool duplicate;
-  String SSID;
-  uint8_t encryptionType;
-  int32_t RSSI;
-  uint8_t *BSSID;
-  int32_t channel;
-  bool isHidden;
-
-  WiFiResult()
+  AsyncWiFiManagerScanPool();
+
+  // buffer the next scan goes into, NULL while a reader still holds it
+  WiFiResult *beginWrite();
+  // make the records written since beginWrite() the current snapshot
+  void publish(wifi_ssid_count_t count);
+
+  // pin the current snapshot, returns its buffer index
+  uint8_t acquire();
+  void release(uint8_t buffer);
+
+  const WiFiResult *records(uint8_t buffer);
+  wifi_ssid_count_t count(uint8_t buffer);
+  // millis() of the publish, 0 if the buffer was never published
+  unsigned long publishedAt(uint8_t buffer);
+
+private:
+  WiFiResult _records[2][WIFI_MANAGER_MAX_SCAN_RESULTS];
+  wifi_ssid_count_t _count[2];
+  unsigned long _publishedAt[2];
+  std::atomic<uint8_t> _front;
+  std::atomic<uint8_t> _readers[2];
+};
+
+// pin on a scan snapshot, released when the last copy goes away
+class AsyncWiFiManagerScanSnapshot
+{
+public:
+  AsyncWiFiManagerScanSnapshot(AsyncWiFiManagerScanPool *pool);
+  ~AsyncWiFiManagerScanSnapshot();
+
+  const WiFiResult *records();
+  wifi_ssid_count_t count();
+  boolean published();
+  unsigned long publishedAt();
+
+private:
+  AsyncWiFiManagerScanSnapshot(const AsyncWiFiManagerScanSnapshot &);
+  AsyncWiFiManagerScanSnapshot &operator=(const AsyncWiFiManagerScanSnapshot &);
+
+  AsyncWiFiManagerScanPool *_pool;
+  uint8_t _buffer;
+};
+
+// Print sink used by the chunked page renderer. A page is rendered once per
+// chunk: bytes before offset are only counted, bytes inside the window are
+// copied to the chunk buffer and everything after it is dropped, so a page
+// never needs more memory than the chunk the web server hands us.
+class AsyncWiFiManagerChunkPrint : public Print
+{
+public:
+  AsyncWiFiManagerChunkPrint(uint8_t *buffer, size_t size, size_t offset);
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+
+  // bytes copied into the chunk buffer
+  size_t length();
+
+private:
+  uint8_t *_buffer;
+  size_t _size;
+  size_t _offset;
+  size_t _pos;
+  size_t _len;
+};
+
+// Streaming JSON writer: members and array items go straight to the Print,
+// commas are tracked per nesting level, strings are escaped on the way out
+class AsyncWiFiManagerJsonWriter
+{
+public:
+  AsyncWiFiManagerJsonWriter(Print &out);
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+  // member name, the next value call writes its value
+  void key(const char *name);
+
+  void value(const char *str);
+  void value(const String &str);
+  void value(int n);
+  void value(unsigned int n);
+  void value(long n);
+  void value(unsigned long n);
+  void value(bool b);
+  void value(const IPAddress &ip);
+  void null();
+  // already encoded JSON, written as is
+  void raw(const String &json);
+
+private:
+  void separator();
+  void string(const char *str);
+
+  Print &_out;
+  uint8_t _depth;
+  uint32_t _hasItems; // one bit per nesting level
+  boolean _afterKey;
+};
+
+typedef std::function<void(Print &)> AsyncWiFiManagerRenderer;
+
+// static file compiled into flash by tools/embed_assets.py
+struct AsyncWiFiManagerAsset
+{
+  const char *path;
+  const char *contentType;
+  const uint8_t *data;
+  size_t length;
+  const char *etag;
+  bool gzipped;
+};
+
+// A PROGMEM template split once into literal and slot spans. Rendering walks
+// the spans and writes them straight to the sink, so a row costs neither a
+// copy of the template nor a rescan per placeholder.
+class AsyncWiFiManagerTemplate
+{
+public:
+  // keys names the slots in the order render() expects their values,
+  // e.g. "vri" for the {v}, {r} and {i} of HTTP_ITEM
+  AsyncWiFiManagerTemplate(PGM_P tpl, const char *keys);
+
+  // values[k] is written for slot keys[k], a NULL value renders nothing
+  void render(Print &out, const char *const *values) const;
+
+private:
+  struct Span
   {
-  }
+    uint16_t offset;
+    uint16_t length;
+    int8_t slot; // index into keys, -1 for literal text
+  };
+
+  PGM_P _tpl;
+  Span _spans[WIFI_MANAGER_MAX_TEMPLATE_SPANS];
+  uint8_t _spanCount;
+};
+
+struct AsyncWiFiManagerDNSStats
+{
+  uint32_t queries;
+  uint32_t answered;
+  uint32_t dropped; // malformed, not a query or the reply could not be sent
+  uint32_t queriesPerSecond;
+};
+
+#ifndef WIFI_MANAGER_MAX_ROUTES
+#define WIFI_MANAGER_MAX_ROUTES 32
+#endif
+#define WIFI_MANAGER_LATENCY_BUCKETS 8
+
+// what the portal's handlers cost, one record per route (USE_WM_METRICS).
+// Latency covers the handler call, a streamed page is written out after it
+// returns and only shows up in bytes; heap is sampled around the handler
+struct AsyncWiFiManagerRouteMetrics
+{
+  const char *route;
+  uint32_t requests;
+  uint32_t bytes;
+  uint64_t latencySum;                            // in us
+  uint32_t latency[WIFI_MANAGER_LATENCY_BUCKETS]; // per bucket, not cumulative
+  uint32_t heapBefore;                            // of the last request
+  uint32_t heapAfter;
+  uint32_t largestBlockAfter;
+  uint32_t minLargestBlock; // smallest largest free block seen after a request
+  uint32_t rejected;        // answered 503 by the admission control
+};
+
+// admission control defaults, see setAdmission()
+#ifndef WIFI_MANAGER_MAX_IN_FLIGHT
+#define WIFI_MANAGER_MAX_IN_FLIGHT 3 // pages per route being served at once
+#endif
+#ifndef WIFI_MANAGER_MIN_FREE_HEAP
+#if defined(ESP8266)
+#define WIFI_MANAGER_MIN_FREE_HEAP 6144
+#else
+#define WIFI_MANAGER_MIN_FREE_HEAP 16384
+#endif
+#endif
+#define WIFI_MANAGER_RETRY_AFTER "2" // seconds, sent with a 503
+
+// one admitted page, the route's in-flight slot is given back when the last
+// copy goes away: after the handler returned and its streamed page is out
+class AsyncWiFiManagerAdmission
+{
+public:
+  AsyncWiFiManagerAdmission(std::atomic<uint8_t> *inFlight);
+  ~AsyncWiFiManagerAdmission();
+
+private:
+  AsyncWiFiManagerAdmission(const AsyncWiFiManagerAdmission &);
+  AsyncWiFiManagerAdmission &operator=(const AsyncWiFiManagerAdmission &);
+
+  std::atomic<uint8_t> *_inFlight;
+};
+
+#if !defined(ESP8266)
+// One-shot esp_timer. It only wakes the loop task, sleeping in waitForWork(),
+// when queued work is due; the work itself runs on the loop. Arming it again
+// moves the deadline
+class AsyncWiFiManagerTimer
+{
+public:
+  AsyncWiFiManagerTimer(void (*callback)(void *), void *arg);
+  ~AsyncWiFiManagerTimer();
+  void once(uint32_t ms);
+  void stop();
+
+private:
+  AsyncWiFiManagerTimer(const AsyncWiFiManagerTimer &);
+  AsyncWiFiManagerTimer &operator=(const AsyncWiFiManagerTimer &);
+
+  void (*_callback)(void *);
+  void *_arg;
+  std::atomic<esp_timer_handle_t> _timer{NULL};
+};
+
+// Captive DNS responder on AsyncUDP: every query is answered from the UDP
+// callback as it arrives, whatever the portal loop is busy with. Replies are
+// the query's header and question followed by a prebuilt A record pointing
+// at the portal.
+class AsyncWiFiManagerDNS
+{
+public:
+  AsyncWiFiManagerDNS();
+
+  boolean start(uint16_t port, IPAddress ip);
+  void stop();
+  AsyncWiFiManagerDNSStats stats();
+
+private:
+  void handlePacket(AsyncUDPPacket &packet);
+
+  AsyncUDP _udp;
+  uint8_t _answer[16];
+  std::atomic<uint32_t> _queries;
+  std::atomic<uint32_t> _answered;
+  std::atomic<uint32_t> _dropped;
+  // queries per second, counted over whole seconds
+  unsigned long _windowStart;
+  uint32_t _windowQueries;
+  uint32_t _rate;
+};
+#endif
+
+// progress of a station connection attempt
+enum AsyncWiFiManagerConnectState
+{
+  WM_CONNECT_IDLE,       // nothing attempted yet
+  WM_CONNECT_CONNECTING, // WiFi.begin() called, waiting for the AP
+  WM_CONNECT_ASSOCIATED, // associated, waiting for an address
+  WM_CONNECT_CONNECTED,  // got an IP address
+  WM_CONNECT_FAILED,     // the AP turned us down
+  WM_CONNECT_TIMEOUT,    // gave up after the connect timeout
+  WM_CONNECT_LOST        // was connected, the link dropped
+};
+
+// the events stream reports a network again once its quality moved this much
+#define WIFI_MANAGER_EVENTS_QUALITY_STEP 5
+
+// what the events stream last told its clients about a network
+struct AsyncWiFiManagerSeenNetwork
+{
+  uint32_t id;
+  uint8_t quality;
+};
+
+// without setConnectTimeout an attempt is given up after this many ms
+#define WIFI_MANAGER_CONNECT_TIMEOUT 10000
+// autoConnect's retry delay doubles up to this many ms
+#define WIFI_MANAGER_MAX_RETRY_DELAY 30000
+// a fast reconnect falls back to the full connect after this many ms
+#define WIFI_MANAGER_FAST_CONNECT_TIMEOUT 3000
+// NVS key of the fast reconnect cache
+#define WIFI_MANAGER_NVS_FAST_RECONNECT "wm_fast"
+// networks kept in the credential store
+#ifndef WIFI_MANAGER_MAX_NETWORKS
+#define WIFI_MANAGER_MAX_NETWORKS 5
+#endif
+// NVS key of the credential store
+#define WIFI_MANAGER_NVS_NETWORKS "wm_nets"
+// a restart requested from the portal waits at most this many ms for the
+// client to close the connection
+#ifndef WIFI_MANAGER_ACTION_DELAY
+#define WIFI_MANAGER_ACTION_DELAY 2000
+#endif
+// a loop waiting for events still runs its timers every this many ms, and
+// every WIFI_MANAGER_DNS_POLL ms while a DNSServer has to be polled
+#define WIFI_MANAGER_LOOP_IDLE 100
+#define WIFI_MANAGER_DNS_POLL 10
+// with power save and nobody on the soft AP, every this many ms
+#define WIFI_MANAGER_LOOP_POWER_SAVE 1000
+// stack of the portal task in bytes
+#ifndef WIFI_MANAGER_TASK_STACK
+#define WIFI_MANAGER_TASK_STACK 6144
+#endif
+// settings changes are collected this many ms before they go to NVS in one commit
+#ifndef WIFI_MANAGER_SETTINGS_FLUSH_DELAY
+#define WIFI_MANAGER_SETTINGS_FLUSH_DELAY 500
+#endif
+
+#if WM_FEATURE_INFO
+// info page facts that do not change while running, read once
+struct AsyncWiFiManagerStaticInfo
+{
+#if defined(ESP8266)
+  uint32_t chipId;
+  uint32_t flashChipId;
+  uint32_t realFlashSize;
+#else
+  char chipId[13];
+#endif
+  uint32_t flashSize;
+  char softAPMac[18];
+  char mac[18];
+};
+#endif
+
+// info page fields that change, refreshed by setInfo() and the connect events
+struct AsyncWiFiManagerLiveInfo
+{
+  char ssid[33];
+  IPAddress ip;
+  IPAddress softAPIP;
+  int8_t rssi; // 0 while not connected
+  wl_status_t status;
+};
+
+// what a handler leaves for the loop to do after its response went out
+enum AsyncWiFiManagerAction
+{
+  WM_ACTION_NONE,
+  WM_ACTION_RESTART,
+  WM_ACTION_ERASE_RESTART // forget the SDK's WiFi settings first
+};
+
+// A save from the portal as the web handler hands it to the loop, fixed size
+// so the handoff needs no heap
+#define WIFI_MANAGER_STATIC_IP_FIELDS 5
+struct AsyncWiFiManagerConnectJob
+{
+  char ssid[33];
+  char pass[65];
+  // ip, gw, sn, dns1 and dns2 from the form, a bit in staticFields for each
+  // one that was given and parsed
+#if WM_FEATURE_STATIC_IP
+  uint8_t staticFields;
+  IPAddress staticIP[WIFI_MANAGER_STATIC_IP_FIELDS];
+#endif
+};
+
+// Last good connection as stored in NVS. Bump the version when the layout
+// changes, old records are then ignored.
+#define WIFI_MANAGER_FAST_RECONNECT_VERSION 1
+struct AsyncWiFiManagerFastReconnect
+{
+  uint8_t version;
+  uint8_t channel;
+  uint8_t bssid[6];
+  char ssid[33];
+  // DHCP lease, 0 when not cached
+  uint32_t ip;
+  uint32_t gw;
+  uint32_t sn;
+  uint32_t dns;
+};
+
+// Credential store as kept in NVS, most recently used network first. The
+// first one is also the network the SDK has persisted.
+#define WIFI_MANAGER_NETWORK_STORE_VERSION 1
+struct AsyncWiFiManagerStoredNetwork
+{
+  char ssid[33];
+  char pass[65];
+};
+
+struct AsyncWiFiManagerNetworkStore
+{
+  uint8_t version;
+  uint8_t count;
+  AsyncWiFiManagerStoredNetwork networks[WIFI_MANAGER_MAX_NETWORKS];
+};
+
+// Log levels. WM_LOG_LEVEL is the most verbose one built in, calls above it
+// compile to nothing, their arguments included. setDebugOutput() still
+// switches the built in levels on and off at run time
+#define WM_LOG_NONE 0
+#define WM_LOG_ERROR 1
+#define WM_LOG_INFO 2
+#define WM_LOG_DEBUG 3
+#define WM_LOG_VERBOSE 4
+#ifndef WM_LOG_LEVEL
+#define WM_LOG_LEVEL WM_LOG_DEBUG
+#endif
+// With a size in bytes, log lines are queued in a ring buffer that a low
+// priority task writes to Serial, so a handler never waits on the UART.
+// Lines that do not fit are dropped and counted. ESP32 only [default 0, off]
+#ifndef WM_LOG_BUFFER
+#define WM_LOG_BUFFER 0
+#endif
+// longer lines are cut when they go through the ring buffer
+#define WIFI_MANAGER_LOG_LINE 128
+
+#if WM_LOG_LEVEL >= WM_LOG_ERROR
+#define WM_LOGE(text) logLine(text)
+#else
+#define WM_LOGE(text) do {} while (0)
+#endif
+#if WM_LOG_LEVEL >= WM_LOG_INFO
+#define WM_LOGI(text) logLine(text)
+#else
+#define WM_LOGI(text) do {} while (0)
+#endif
+#if WM_LOG_LEVEL >= WM_LOG_DEBUG
+#define WM_LOGD(text) logLine(text)
+#else
+#define WM_LOGD(text) do {} while (0)
+#endif
+#if WM_LOG_LEVEL >= WM_LOG_VERBOSE
+#define WM_LOGV(text) logLine(text)
+#else
+#define WM_LOGV(text) do {} while (0)
+#endif
+#define DEBUG_WM(text) WM_LOGD(text)
+
+// where the pages are served: behind the captive portal on the soft AP
+// (setupConfigPortal) or as api calls on the station's network (setupApiCalls)
+enum AsyncWiFiManagerPortalMode
+{
+  WM_MODE_AP,
+  WM_MODE_STA
 };
 
 class AsyncWiFiManager
@@ -127,14 +597,19 @@ public:
 #else
   AsyncWiFiManager(AsyncWebServer *server, DNSServer *dns);
 #endif
+  ~AsyncWiFiManager();
 
   void scan(boolean async = false);
-  void scanSTA(WiFiResult *wifiSSIDs2, wifi_ssid_count_t *wifiSSIDCount2);
+  // ask the scan scheduler for a fresh scan as soon as possible
+  void requestScan();
   String scanModal();
   void loop();
   void safeLoop();
   void criticalLoop();
+#if WM_FEATURE_INFO
   String infoAsString();
+  String infoAsJson();
+#endif
 
   boolean autoConnect(unsigned long maxConnectRetries = 1,
                       unsigned long retryDelayMs = 1000);
@@ -143,11 +618,14 @@ public:
                       unsigned long maxConnectRetries = 1,
                       unsigned long retryDelayMs = 1000);
 
+#if WM_FEATURE_STA_API
   void staModeSetup();
   void setupApiCalls();
+#endif
 
   // if you want to always start the config portal, without trying to connect first
   boolean startConfigPortal(char const *apName, char const *apPassword = NULL);
+  // same as startConfigPortal, kept for older sketches
   boolean startConfigPortalSTA(char const *apName, char const *apPassword);
 
   void startConfigPortalModeless(char const *apName, char const *apPassword);
@@ -163,8 +641,71 @@ public:
   void setConfigPortalTimeout(unsigned long seconds);
   void setTimeout(unsigned long seconds);
 
+  // portal rescans every seconds while a station is attached to the soft AP,
+  // with nobody attached the interval doubles after each scan up to idleSeconds
+  // [default 10 seconds modal, 60 seconds modeless]
+  void setScanInterval(unsigned long seconds, unsigned long idleSeconds = 60);
+  // scan pages answer from the last scan, one older than this starts a
+  // background refresh [default 30 seconds]
+  void setScanCacheTTL(unsigned long seconds);
+  // while no station is attached to the soft AP the portal loop sleeps
+  // longer between passes and scans pause, the reconnect attempts of the
+  // modal portal go on every idleSeconds. A joining station ends it [default off]
+  void setPowerSave(boolean enable);
+  // start the soft AP on the least crowded of channels 1, 6 and 11 by the
+  // last scan, scanning first when it is stale. While the portal tries to
+  // reconnect, the channel of the last network instead [default off]
+  void setChannelPlanning(boolean enable);
+  // Admission control for the portal's pages and api calls: at most
+  // maxInFlight responses per route at once, and none while less than
+  // minFreeHeap bytes are free. Over budget a request is answered 503 with
+  // Retry-After. 0 turns a check off
+  // [default WIFI_MANAGER_MAX_IN_FLIGHT, WIFI_MANAGER_MIN_FREE_HEAP]
+  void setAdmission(uint8_t maxInFlight, uint32_t minFreeHeap);
+
   // sets timeout for which to attempt connecting, usefull if you get a lot of failed connects
   void setConnectTimeout(unsigned long seconds);
+  // networks autoConnect falls back to when the last one is out of reach, the
+  // store keeps WIFI_MANAGER_MAX_NETWORKS of them, most recently used first.
+  // Networks saved through the portal are added automatically
+  boolean addNetwork(const char *ssid, const char *pass);
+  boolean removeNetwork(const char *ssid);
+  uint8_t getNetworkCount();
+
+  // Settings changes (stand alone flag, credential store, fast reconnect
+  // cache) are kept in RAM and written to NVS from loop() a little later.
+  // Writes them now, call it before restarting after addNetwork() and friends
+  void flushSettings();
+
+  // answer the portal's DNS with the built in AsyncUDP responder instead of
+  // the DNSServer passed in, ESP32 only [default false]
+  void setBuiltinDNS(boolean enable);
+
+#if !defined(ESP8266)
+  // run loop() in a task of its own, started by startConfigPortalModeless()
+  // and setupApiCalls(). The task sleeps until a request, a WiFi event or a
+  // timer needs it. Callbacks then run on that task and a loop() call from
+  // the sketch does nothing [default off]
+  void setPortalTask(boolean enable,
+                     BaseType_t core = tskNO_AFFINITY,
+                     UBaseType_t priority = 1,
+                     uint32_t stackSize = WIFI_MANAGER_TASK_STACK);
+#endif
+  // counters of the built in DNS responder, zero when it is not used
+  AsyncWiFiManagerDNSStats getDNSStats();
+
+#ifdef USE_WM_METRICS
+  // copies up to max route records into metrics and returns how many there are
+  uint8_t getRouteMetrics(AsyncWiFiManagerRouteMetrics *metrics, uint8_t max);
+#endif
+
+  // upper bound for autoConnect before it opens the portal, attempts are cut
+  // short to meet it [default 0, no bound besides the connect timeouts]
+  void setMaxTimeToPortal(unsigned long seconds);
+
+  // remember BSSID and channel of the last good connection in NVS, and with
+  // cacheIpLease its DHCP lease, and try those first on the next boot [default off]
+  void setFastReconnect(boolean enable, boolean cacheIpLease = false);
 
   // wether or not the wifi manager tries to connect to configured access point even when
   // configuration portal (ESP as access point) is running [default true/on]
@@ -185,7 +726,15 @@ public:
   void setAPCallback(std::function<void(AsyncWiFiManager *)>);
   // called when settings have been changed and connection was successful
   void setSaveConfigCallback(std::function<void()> func);
-  //adds a custom parameter
+  // called once per connection attempt when it is decided: connected, failed
+  // or timed out, with the last disconnect reason. May run on the WiFi event task
+  void setConnectCallback(std::function<void(AsyncWiFiManagerConnectState, uint8_t)> func);
+  // state of the current or last connection attempt
+  AsyncWiFiManagerConnectState getConnectState();
+  // reason code of the last station disconnect, 0 if there was none
+  uint8_t getDisconnectReason();
+  //adds a custom parameter, its value moves into the manager, which has to
+  //outlive it or be destroyed first
   void addParameter(AsyncWiFiManagerParameter *p);
   // if this is set, it will exit after config, even if connection is unsucessful
   void setBreakAfterConfig(boolean shouldBreak);
@@ -193,7 +742,8 @@ public:
   // TODO
   // if this is set, customise style
   void setCustomHeadElement(const char *element);
-  // if this is true, remove duplicated Access Points - defaut true
+  // if this is true, remove duplicated Access Points - defaut true, no effect
+  // without WM_FEATURE_REMOVE_DUPLICATES
   void setRemoveDuplicateAPs(boolean removeDuplicates);
   // sets a custom element to add to options page
   void setCustomOptionsElement(const char *element);
@@ -214,20 +764,88 @@ private:
 #endif
 
   boolean _modeless;
-  unsigned long scannow;
   boolean shouldscan = true;
+
+  // scan scheduler
+  std::atomic<bool> _scanRequested{false};
+  std::atomic<bool> _scanRunning{false};
+  std::atomic<bool> _scanStarting{false}; // one caller at a time in startScan()
+  unsigned long _scanStarted = 0;
+  unsigned long _lastScan = 0;
+  unsigned long _scanInterval = 0; // 0: the portal's own default
+  unsigned long _scanIdleInterval = 60000;
+  unsigned long _scanBackoff = WIFI_MANAGER_SCAN_INTERVAL;
+  unsigned long _scanCacheTTL = 30000;
+  unsigned long scanInterval();
+  void requestPageScan();
+#if WM_FEATURE_STA_API && !defined(ESP8266)
+  wifi_event_id_t _scanEventId = 0;
+#endif
+  boolean scheduleScan(boolean stopConnecting);
+
+  // power save, _stations as of the last loop pass
+  boolean _powerSave = false;
+  uint8_t _stations = 0;
+  unsigned long _lastReconnect = 0;
+  boolean reconnectDue();
+#if !defined(ESP8266)
+  wifi_event_id_t _stationEventId = 0;
+#endif
+  void updateStations();
+
+  boolean _channelPlanning = false;
+  uint8_t planChannel();
+  boolean startScan();
+  boolean finishScan();
+#if WM_FEATURE_STA_API
+  void setupScanEvent();
+#endif
+  AsyncWebServerResponse *beginScanResponse(AsyncWebServerRequest *request,
+                                            AsyncWiFiManagerScanSnapshot &snapshot,
+                                            AsyncWiFiManagerRenderer render,
+                                            boolean json = false);
   boolean needInfo = true;
 
+  // /api/v2/wifi/events, scan deltas and connect state changes, sent from the
+  // loop. The server owns it, its reset() deletes it and leaves us NULL
+  AsyncEventSource *_events = NULL;
+  AsyncWiFiManagerSeenNetwork _seen[WIFI_MANAGER_MAX_SCAN_RESULTS];
+  wifi_ssid_count_t _seenCount = 0;
+  unsigned long _seenScanAt = 0;
+  boolean _seenSynced = false; // _seen is what the listening clients were told
+  uint8_t _sentState = WM_CONNECT_IDLE;
+  void setupEvents(AsyncWiFiManagerPortalMode mode);
+  void sendEvents();
+  void sendScanEvent();
+  void sendStateEvent();
+  uint32_t networkId(const WiFiResult &result);
+  void renderNetworksEvent(AsyncWiFiManagerJsonWriter &json, AsyncWiFiManagerScanSnapshot &snapshot);
+  void renderNetworkEvent(AsyncWiFiManagerJsonWriter &json, const WiFiResult &result);
+  void renderStateEvent(AsyncWiFiManagerJsonWriter &json);
+
   //const int     WM_DONE                 = 0;
   //const int     WM_WAIT                 = 10;
   //const String  HTTP_HEAD = "<!DOCTYPE html><html lang=\"en\"><head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\"/><title>{v}</title>";
 
   void setupConfigPortal();
-#ifdef NO_EXTRA_4K_HEAP
+#if WM_FEATURE_WPS
   void startWPS();
 #endif
-  String pager;
-  wl_status_t wifiStatus;
+  // the handlers render the info page from these, without touching WiFi
+#if WM_FEATURE_INFO
+  AsyncWiFiManagerStaticInfo _staticInfo;
+  boolean _staticInfoReady = false;
+  void loadStaticInfo();
+#endif
+  AsyncWiFiManagerLiveInfo _liveInfo;
+#if !defined(ESP8266)
+  portMUX_TYPE _infoLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+  void refreshLiveInfo();
+  AsyncWiFiManagerLiveInfo liveInfo();
+  // soft AP address and the redirect to the portal on it, set up once
+  IPAddress _portalIP;
+  String _portalLocation;
   const char *_apName = "no-net";
   const char *_apPassword = NULL;
   String _ssid = "";
@@ -245,11 +863,10 @@ private:
   IPAddress _sta_static_dns1 = (uint32_t)0x00000000;
   IPAddress _sta_static_dns2 = (uint32_t)0x00000000;
 
-  unsigned int _paramsCount = 0;
   unsigned int _minimumQuality = 0;
-  boolean _removeDuplicateAPs = true;
+  boolean _removeDuplicateAPs = WM_FEATURE_REMOVE_DUPLICATES;
   boolean _shouldBreakAfterConfig = false;
-#ifdef NO_EXTRA_4K_HEAP
+#if WM_FEATURE_WPS
   boolean _tryWPS = false;
 #endif
   const char *_customHeadElement = "";
@@ -260,27 +877,225 @@ private:
 
   uint8_t status = WL_IDLE_STATUS;
   uint8_t connectWifi(String ssid, String pass);
-  uint8_t connectWifiSTA(String ssid, String pass);
   uint8_t waitForConnectResult();
+
+  // connection state machine, driven by the WiFi events on ESP32 and by
+  // WiFi.status() on ESP8266
+  std::atomic<uint8_t> _connectState{WM_CONNECT_IDLE};
+  std::atomic<uint8_t> _disconnectReason{0};
+  unsigned long _connectStarted = 0;
+  unsigned long _attemptTimeout = WIFI_MANAGER_CONNECT_TIMEOUT;
+  boolean _saveConnecting = false; // attempt started from the save page
+#if !defined(ESP8266)
+  EventGroupHandle_t _connectEvents = NULL;
+  wifi_event_id_t _connectEventId = 0;
+  void onConnectEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+#endif
+  void beginConnect(String ssid, String pass, boolean staticIP = true);
+  // timeoutMs 0 uses the connect timeout
+  void startConnectAttempt(unsigned long timeoutMs = 0);
+  void setConnectState(AsyncWiFiManagerConnectState state);
+  AsyncWiFiManagerConnectState pollConnect();
+  // timeoutMs 0 waits until the attempt is decided
+  AsyncWiFiManagerConnectState waitForConnect(unsigned long timeoutMs, boolean untilConnected);
+
+  // fast reconnect cache
+  boolean _fastReconnect = false;
+  boolean _fastReconnectLease = false;
+  boolean beginFastReconnect();
+  void storeFastReconnect();
+  void forgetFastReconnect();
+
+  // try the stored networks in range after the last one failed
+  boolean connectKnownNetwork();
+
+  // settings cache, NVS is read once and changes are written back by
+  // flushSettings(), from the loops once nothing changed for
+  // WIFI_MANAGER_SETTINGS_FLUSH_DELAY
+  boolean _settingsLoaded = false;
+#if WM_FEATURE_STAND_ALONE
+  boolean _standAlone = false;
+#endif
+  boolean _fastReconnectValid = false;
+  AsyncWiFiManagerFastReconnect _fastReconnectRecord;
+  AsyncWiFiManagerNetworkStore _networkStore;
+  std::atomic<uint8_t> _settingsDirty{0};
+  std::atomic<unsigned long> _settingsChanged{0};
+#if !defined(ESP8266)
+  // handlers change the settings on the async_tcp task
+  portMUX_TYPE _settingsLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+  void loadSettings();
+  void markSettings(uint8_t dirty);
+#if WM_FEATURE_STAND_ALONE
+  boolean getStandAlone();
+  void setStandAlone(boolean standAlone);
+#endif
+
+  // Single slot from handleWifiSave to the loop, a sequence lock: the
+  // sequence is odd while the handler writes the job, the loop takes a job
+  // whose even sequence it has not taken yet and retries if it changed
+  // during the copy. A newer save replaces one that was not taken
+  AsyncWiFiManagerConnectJob _connectJob;
+  std::atomic<uint32_t> _connectJobSeq{0};
+  std::atomic<uint32_t> _connectJobTaken{0};
+  void publishConnectJob(const AsyncWiFiManagerConnectJob &job);
+  boolean takeConnectJob(AsyncWiFiManagerConnectJob *job);
+  boolean connectJobPending();
+  void dropConnectJob();
+  // _ssid, _pass and the static config from a taken job
+  void applyConnectJob(const AsyncWiFiManagerConnectJob &job);
+
+  // the loop, in the portal task or the modal portal, sleeps in
+  // waitForWork() until wake() or its next timer
+#if !defined(ESP8266)
+  boolean _portalTaskEnabled = false;
+  BaseType_t _portalTaskCore = tskNO_AFFINITY;
+  UBaseType_t _portalTaskPriority = 1;
+  uint32_t _portalTaskStack = WIFI_MANAGER_TASK_STACK;
+  std::atomic<TaskHandle_t> _portalTask{NULL};
+  std::atomic<bool> _portalTaskStop{false};
+  std::atomic<TaskHandle_t> _loopTask{NULL};
+  static void portalTask(void *arg);
+  void startPortalTask();
+#endif
+  void stopPortalTask();
+  boolean ownsLoop();
+  void wake();
+  void wakeIn(uint32_t ms);
+  void waitForWork();
+
+  // restart queued by a handler, run by criticalLoop() or the portal loop,
+  // whichever gets there first
+  std::atomic<uint8_t> _pendingAction{WM_ACTION_NONE};
+  std::atomic<unsigned long> _pendingActionAt{0};
+  void deferAction(AsyncWebServerRequest *request, AsyncWiFiManagerAction action);
+  void runPendingAction();
+#if !defined(ESP8266)
+  AsyncWiFiManagerTimer _serviceTimer{serviceTimer, this};
+  static void serviceTimer(void *arg);
+#endif
+
+  boolean _builtinDNS = false;
+#if !defined(ESP8266)
+  AsyncWiFiManagerDNS _dns;
+#endif
+  void startDNS();
+  void processDNS();
+  void stopDNS();
+
+  unsigned long _maxTimeToPortal = 0;
+  unsigned long _connectDeadline = 0; // 0 while autoConnect is not running
+  unsigned long connectTimeLeft();
   void setInfo();
-  String setInfoSTA();
+  void reportScan(wifi_ssid_count_t n);
+  // Source is where the networks are read from: the driver's scan list, or
+  // records for a synthetic scan
+  template <typename Source>
+  wifi_ssid_count_t indexScanResults(Source &source,
+                                     wifi_ssid_count_t n,
+                                     WiFiResult *results,
+                                     wifi_ssid_count_t limit,
+                                     boolean removeDuplicates,
+                                     boolean filterQuality);
+  template <typename Source>
+  void harvestScan(Source &source,
+                   wifi_ssid_count_t n,
+                   wifi_ssid_count_t limit,
+                   boolean removeDuplicates,
+                   boolean filterQuality);
   void copySSIDInfo(wifi_ssid_count_t n);
-  void copySSIDInfoSTA(wifi_ssid_count_t n, WiFiResult *wifiSSIDs2);
+  // run records through the same sort, filter and dedup as a real scan
+  void copySSIDInfo(const WiFiResult *records, wifi_ssid_count_t n);
   String networkListAsString();
-  String networkListAsStringSTA( WiFiResult *wifiSSIDs2, wifi_ssid_count_t wifiSSIDCount2);
-
-  void handleRoot(AsyncWebServerRequest *);
-  void handleRootSTA(AsyncWebServerRequest *);
-  void handleWifi(AsyncWebServerRequest *, boolean scan);
-  void handleWifiSTA(AsyncWebServerRequest *, boolean scan);
-  void handleWifiSave(AsyncWebServerRequest *);
-  void handleWifiSaveSTA(AsyncWebServerRequest *);
-  void handleInfo(AsyncWebServerRequest *);
-  void handleInfoSTA(AsyncWebServerRequest *);
-  void handleReset(AsyncWebServerRequest *);
-  void handleResetSTA(AsyncWebServerRequest *);
-  void handleStandAlone(AsyncWebServerRequest *);
-  void handleStandAloneSTA(AsyncWebServerRequest *);
+
+  // streaming page rendering
+  AsyncWebServerResponse *beginPageResponse(AsyncWebServerRequest *request,
+                                            AsyncWiFiManagerRenderer render,
+                                            const char *contentType = "text/html");
+  void sendPage(AsyncWebServerRequest *request,
+                AsyncWiFiManagerRenderer render,
+                const char *contentType = "text/html");
+  void renderHead(Print &out, const char *title, const char *headElement, const __FlashStringHelper *extra = NULL);
+  void renderNetworkList(Print &out, AsyncWiFiManagerScanSnapshot &snapshot);
+  // params is the block paramsAsString() rendered when the response began
+  void renderConfigPage(Print &out, AsyncWiFiManagerScanSnapshot &snapshot, const String &params, AsyncWiFiManagerPortalMode mode);
+  String paramsAsString();
+  void renderParams(Print &out);
+  const char *headElement(AsyncWiFiManagerPortalMode mode);
+  const char *optionsElement(AsyncWiFiManagerPortalMode mode);
+#if WM_FEATURE_STATIC_IP
+  void renderIPParam(Print &out, const char *id, const char *placeholder, IPAddress ip);
+#endif
+#if WM_FEATURE_INFO
+  // json NULL renders the HTML rows
+  void renderInfo(Print &out, const AsyncWiFiManagerLiveInfo &live, AsyncWiFiManagerJsonWriter *json = NULL);
+#endif
+
+  // JSON flavour of the api routes, for ?format=json or Accept: application/json
+  boolean wantsJson(AsyncWebServerRequest *request);
+  void sendScanJson(AsyncWebServerRequest *request);
+  void renderNetworkListJson(AsyncWiFiManagerJsonWriter &json, AsyncWiFiManagerScanSnapshot &snapshot);
+  void sendSavedJson(AsyncWebServerRequest *request, const String &ssid);
+#if WM_FEATURE_STAND_ALONE
+  void sendStandAloneJson(AsyncWebServerRequest *request);
+#endif
+
+  // one table of routes, registered for either mode
+  typedef void (AsyncWiFiManager::*RouteHandler)(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode);
+  struct Route
+  {
+    const char *uri;
+    WebRequestMethodComposite method;
+    RouteHandler handler;
+  };
+  static const Route ROUTES[];
+  void setupRoutes(AsyncWiFiManagerPortalMode mode);
+
+  // admission control, one in-flight count per entry of ROUTES. Handlers all
+  // run in the web server's task, only the release may come from elsewhere
+  uint8_t _maxInFlight = WIFI_MANAGER_MAX_IN_FLIGHT;
+  uint32_t _minFreeHeap = WIFI_MANAGER_MIN_FREE_HEAP;
+  std::atomic<uint8_t> _inFlight[WIFI_MANAGER_MAX_ROUTES] = {};
+  // slot of the handler running right now, the page it streams holds a copy
+  std::shared_ptr<AsyncWiFiManagerAdmission> _currentAdmission;
+  ArRequestHandlerFunction admit(uint8_t route, ArRequestHandlerFunction fn);
+  void sendBusy(AsyncWebServerRequest *request);
+
+  void handleRoot(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+  void handleWifi(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+  void handleWifiSave(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+#if WM_FEATURE_STATIC_IP
+  void parseStaticIP(AsyncWebServerRequest *, AsyncWiFiManagerConnectJob *job);
+#endif
+#if WM_FEATURE_INFO
+  void handleInfo(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+#endif
+  void handleProbe(AsyncWebServerRequest *);
+  void handleReset(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+#if WM_FEATURE_STAND_ALONE
+  void handleStandAlone(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+  void handleStandAloneYes(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+  void handleStandAloneNo(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+#endif
+  void handleAsset(AsyncWebServerRequest *, const AsyncWiFiManagerAsset *asset);
+  void setupAssets(boolean apOnly);
+
+  // every route goes through here so it can be instrumented
+  AsyncCallbackWebHandler &route(const char *uri, ArRequestHandlerFunction fn);
+  AsyncCallbackWebHandler &route(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn);
+  ArRequestHandlerFunction instrument(const char *uri, ArRequestHandlerFunction fn);
+#ifdef USE_WM_METRICS
+  AsyncWiFiManagerRouteMetrics *routeMetrics(const char *uri);
+  void handleMetrics(AsyncWebServerRequest *, AsyncWiFiManagerPortalMode mode);
+  void renderMetrics(Print &out, const AsyncWiFiManagerRouteMetrics *metrics, uint8_t count, boolean json);
+  static uint32_t largestFreeBlock();
+
+  AsyncWiFiManagerRouteMetrics _metrics[WIFI_MANAGER_MAX_ROUTES];
+  uint8_t _metricsCount = 0;
+  // route of the handler running right now, for the bytes of its response
+  AsyncWiFiManagerRouteMetrics *_currentMetrics = NULL;
+#endif
   void handleNotFound(AsyncWebServerRequest *);
   boolean captivePortal(AsyncWebServerRequest *);
 
@@ -289,25 +1104,37 @@ private:
 
   // helpers
   unsigned int getRSSIasQuality(int RSSI);
-  boolean isIp(String str);
+  boolean isIp(const String &str);
   String toStringIp(IPAddress ip);
 
-  boolean connect;
   boolean _debug = true;
 
-  WiFiResult *wifiSSIDs;
-  wifi_ssid_count_t wifiSSIDCount;
+  AsyncWiFiManagerScanPool _scanPool;
   boolean wifiSSIDscan;
 
   boolean _tryConnectDuringConfigPortal = true;
 
   std::function<void(AsyncWiFiManager *)> _apcallback;
   std::function<void()> _savecallback;
+  std::function<void(AsyncWiFiManagerConnectState, uint8_t)> _connectcallback;
 
-  AsyncWiFiManagerParameter *_params[WIFI_MANAGER_MAX_PARAMS];
+  // custom parameters in the order they were added. Their values live back
+  // to back in one arena, _paramSlots is an open addressing table of their
+  // ids (slot value is index into _params + 1) for the save handler
+  std::vector<AsyncWiFiManagerParameter *> _params;
+  char *_paramValues = NULL;
+  size_t _paramValuesSize = 0;
+  size_t _paramValuesCapacity = 0;
+  uint16_t *_paramSlots = NULL;
+  uint16_t _paramSlotCount = 0;
+  boolean growParamValues(size_t size);
+  void indexParams();
+  AsyncWiFiManagerParameter *findParam(const char *id);
+  void saveParams(AsyncWebServerRequest *request);
 
   template <typename Generic>
-  void DEBUG_WM(Generic text);
+  void logLine(Generic text);
+  void startLogSink();
 
   template <class T>
   auto optionalIPFromString(T *obj, const char *s) -> decltype(obj->fromString(s))
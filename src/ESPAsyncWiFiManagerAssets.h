@@ -0,0 +1,105 @@
+// generated by tools/embed_assets.py from assets/, do not edit
+
+#ifndef ESPAsyncWiFiManagerAssets_h
+#define ESPAsyncWiFiManagerAssets_h
+
+// lock.png: 214 bytes, stored
+const uint8_t WM_ASSET_LOCK[] PROGMEM = {
+  0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+  0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x20, 0x08, 0x03, 0x00, 0x00, 0x00, 0x44, 0xa4, 0x8a,
+  0xc6, 0x00, 0x00, 0x00, 0x2d, 0x50, 0x4c, 0x54, 0x45, 0xff, 0xff, 0xff, 0x04, 0x07, 0x07, 0xc1,
+  0xc2, 0xc2, 0xf0, 0xf0, 0xf0, 0x33, 0x36, 0x36, 0x82, 0x83, 0x83, 0x53, 0x55, 0x55, 0x23, 0x26,
+  0x26, 0x43, 0x45, 0x45, 0x14, 0x17, 0x17, 0x62, 0x64, 0x64, 0xa1, 0xa3, 0xa3, 0x92, 0x93, 0x93,
+  0xe0, 0xe1, 0xe1, 0x72, 0x74, 0x74, 0xc2, 0x8d, 0xa7, 0xf7, 0x00, 0x00, 0x00, 0x64, 0x49, 0x44,
+  0x41, 0x54, 0x38, 0x8d, 0xed, 0x8d, 0x4b, 0x0e, 0xc0, 0x20, 0x08, 0x44, 0x05, 0xa9, 0x8a, 0x9f,
+  0xde, 0xff, 0xb8, 0xc5, 0xc4, 0x18, 0x1b, 0xe8, 0xce, 0x45, 0x9b, 0xf4, 0x2d, 0x99, 0xc7, 0x8c,
+  0x73, 0x5b, 0x29, 0x01, 0x84, 0x50, 0x1e, 0x62, 0x9f, 0x60, 0x90, 0xbc, 0x99, 0x13, 0x4c, 0xc8,
+  0x32, 0x7a, 0x3d, 0x9f, 0x88, 0x35, 0xf6, 0x19, 0x9d, 0x63, 0x7f, 0x6c, 0x73, 0x0a, 0x95, 0x90,
+  0xe5, 0xda, 0xc6, 0x98, 0x74, 0x64, 0x25, 0xd0, 0x72, 0xac, 0x52, 0xa6, 0x04, 0x29, 0x38, 0xd6,
+  0xb9, 0xf7, 0x09, 0x11, 0x0c, 0xe2, 0xfd, 0xdd, 0xe0, 0x17, 0xbe, 0x29, 0xb0, 0x95, 0xb3, 0xdb,
+  0xc3, 0x05, 0x40, 0x7a, 0x02, 0xd2, 0xd4, 0x71, 0x9f, 0x64, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45,
+  0x4e, 0x44, 0xae, 0x42, 0x60, 0x82,
+};
+
+// wm.css: 380 bytes, 260 gzipped
+const uint8_t WM_ASSET_CSS[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x90, 0xdd, 0x6e, 0x83, 0x30,
+  0x0c, 0x85, 0x5f, 0x25, 0xea, 0x34, 0x69, 0x93, 0x96, 0x0c, 0x4a, 0x5b, 0xb5, 0x89, 0xa6, 0x3d,
+  0x8b, 0x21, 0x0e, 0x44, 0x0d, 0x09, 0x4b, 0x0d, 0x6d, 0x87, 0x78, 0xf7, 0xf1, 0xd3, 0x69, 0x5c,
+  0xec, 0xce, 0xf6, 0xf1, 0xb1, 0x3f, 0x5b, 0x14, 0x3d, 0xe1, 0x8d, 0x38, 0x38, 0x5b, 0x7a, 0xc9,
+  0x0a, 0xf4, 0x84, 0x51, 0x0d, 0xda, 0x76, 0x6f, 0xd6, 0x37, 0x2d, 0xf5, 0x0d, 0x68, 0x6d, 0x7d,
+  0x29, 0xf7, 0xcd, 0x4d, 0x99, 0xe0, 0x89, 0x5f, 0xec, 0x37, 0xca, 0x14, 0x6b, 0x35, 0x2c, 0x0d,
+  0x57, 0xab, 0xa9, 0x92, 0xa7, 0xfd, 0xb3, 0x1a, 0xf2, 0xa0, 0xef, 0xff, 0x8d, 0x9b, 0x7d, 0x06,
+  0x6a, 0xeb, 0xee, 0xb2, 0xc3, 0xa8, 0xc1, 0xc3, 0xd8, 0xdc, 0x12, 0x05, 0xdf, 0xe7, 0x21, 0x6a,
+  0x8c, 0x32, 0x51, 0x4b, 0xc0, 0x23, 0x68, 0xdb, 0x5e, 0x64, 0x22, 0xb2, 0x38, 0xee, 0xc8, 0xa1,
+  0x38, 0x97, 0x31, 0xb4, 0x5e, 0xf3, 0x22, 0xb8, 0x10, 0xe5, 0x53, 0x6a, 0x20, 0xc3, 0x42, 0x3d,
+  0x32, 0x63, 0x8c, 0x72, 0xd6, 0x23, 0xaf, 0xd0, 0x96, 0x15, 0xc9, 0xad, 0xd8, 0x4d, 0xb6, 0x15,
+  0xa8, 0xd8, 0x4e, 0x85, 0x05, 0x32, 0x4d, 0x92, 0x91, 0x52, 0x7c, 0xf5, 0xc6, 0x05, 0x20, 0xc9,
+  0xe2, 0xe4, 0x79, 0x68, 0xec, 0xb0, 0x1b, 0x2f, 0x5c, 0xc3, 0x2f, 0xea, 0x20, 0x5c, 0xff, 0x47,
+  0x21, 0x59, 0x1b, 0xdd, 0xcb, 0xe6, 0xfd, 0x5a, 0x73, 0x17, 0x8a, 0xb3, 0x68, 0x7c, 0xf9, 0xd9,
+  0x7d, 0x00, 0x1c, 0xb3, 0xf4, 0x70, 0x3a, 0x6e, 0x5e, 0x99, 0x0f, 0x3c, 0x62, 0x83, 0x40, 0xcc,
+  0xa1, 0xa1, 0xdf, 0x07, 0xac, 0xce, 0x98, 0xa9, 0xd8, 0xfc, 0xbf, 0x1f, 0xef, 0x51, 0x5a, 0xbf,
+  0x7c, 0x01, 0x00, 0x00,
+};
+
+// wm.js: 1461 bytes, 759 gzipped
+const uint8_t WM_ASSET_JS[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8d, 0x54, 0x4d, 0x6f, 0xdb, 0x38,
+  0x10, 0xbd, 0xfb, 0x57, 0xb0, 0x2d, 0x36, 0x24, 0x11, 0x97, 0xde, 0xf6, 0xb8, 0x8a, 0x5a, 0xb4,
+  0xdd, 0x00, 0xbb, 0x45, 0x92, 0x02, 0x6d, 0x6f, 0x41, 0x0e, 0x0c, 0x39, 0xb2, 0x08, 0x53, 0xa4,
+  0x4c, 0x52, 0x92, 0x03, 0x3b, 0xff, 0x7d, 0x87, 0xf2, 0x47, 0x6d, 0xac, 0x03, 0xf4, 0x22, 0x91,
+  0x1c, 0xce, 0x9b, 0x37, 0x33, 0x6f, 0x58, 0x75, 0x4e, 0x25, 0xe3, 0x1d, 0x51, 0xcc, 0xf2, 0xb5,
+  0xf6, 0xaa, 0x6b, 0xc0, 0x25, 0x31, 0x87, 0x74, 0x6d, 0x21, 0x2f, 0x3f, 0x3f, 0xfd, 0xab, 0x19,
+  0x8d, 0x94, 0x8b, 0x5e, 0xda, 0x0e, 0x4a, 0x2b, 0x8c, 0x73, 0x10, 0x7e, 0xc2, 0x2a, 0x6d, 0x36,
+  0x56, 0x24, 0xfc, 0x7f, 0xf1, 0x2e, 0xe1, 0xcd, 0xe2, 0x45, 0xef, 0x16, 0xbd, 0x2b, 0x34, 0x46,
+  0xc6, 0x8b, 0xe7, 0xc9, 0x6c, 0x46, 0x16, 0x00, 0x6d, 0x24, 0xa9, 0x06, 0xe2, 0x20, 0x0d, 0x3e,
+  0x2c, 0x88, 0x35, 0x31, 0x11, 0xf6, 0xc6, 0x71, 0x22, 0x9d, 0x26, 0x92, 0x28, 0x8f, 0x51, 0x54,
+  0x22, 0x32, 0x25, 0x68, 0xda, 0x6c, 0x1a, 0x38, 0x5e, 0xea, 0x81, 0x54, 0xc1, 0x37, 0x64, 0x26,
+  0x5b, 0x33, 0xeb, 0xdf, 0xcf, 0x06, 0x53, 0x99, 0x19, 0xf4, 0x18, 0x29, 0x4e, 0x0e, 0xe1, 0xa5,
+  0xd6, 0xd7, 0xf9, 0xe8, 0x06, 0x31, 0x01, 0xb9, 0x32, 0xfa, 0xf7, 0xb7, 0xdb, 0x1d, 0xc9, 0x1b,
+  0x2f, 0x35, 0x68, 0x3a, 0xad, 0x76, 0x79, 0x33, 0xbe, 0x9e, 0xf4, 0x32, 0x10, 0x57, 0xbe, 0xc8,
+  0xde, 0x51, 0x3e, 0x1d, 0x5e, 0x36, 0x0f, 0x68, 0x6e, 0xca, 0xf5, 0xf3, 0x34, 0x95, 0x7f, 0x16,
+  0x13, 0x53, 0xb1, 0x57, 0xcc, 0x6d, 0x36, 0x03, 0xdf, 0x6c, 0x5e, 0x0d, 0xc6, 0x69, 0x3f, 0x88,
+  0x91, 0xcc, 0x0f, 0xdf, 0x05, 0x05, 0x3c, 0x40, 0xea, 0x82, 0x2b, 0xc6, 0x98, 0x50, 0x3a, 0x18,
+  0xc8, 0x91, 0x95, 0xd1, 0x33, 0x79, 0x51, 0x5e, 0x4c, 0xf6, 0x6c, 0x49, 0xdb, 0x25, 0x26, 0xf9,
+  0x3a, 0x7b, 0xeb, 0xb2, 0xb9, 0x97, 0xc2, 0xe8, 0x87, 0x22, 0xc7, 0xd4, 0xd8, 0xbc, 0xfd, 0xc1,
+  0x2f, 0xae, 0x2a, 0x80, 0x4c, 0xb0, 0xa3, 0xcb, 0xa8, 0x36, 0x3d, 0xa2, 0xe9, 0x6d, 0x07, 0xff,
+  0xf9, 0x79, 0x7b, 0x53, 0xbe, 0xbe, 0x92, 0xa4, 0x0e, 0x50, 0x95, 0xf4, 0x4d, 0x4b, 0x89, 0x77,
+  0xca, 0x1a, 0xb5, 0x28, 0xa9, 0x62, 0xa9, 0x36, 0x91, 0xd3, 0x0f, 0x57, 0x33, 0xf9, 0xe1, 0xc2,
+  0x3d, 0xc6, 0xb6, 0xb8, 0x8a, 0xad, 0x74, 0xb8, 0x1f, 0x7f, 0xaf, 0x11, 0xa4, 0x32, 0x21, 0xa6,
+  0x2f, 0xb5, 0xb1, 0xfa, 0x58, 0x04, 0xa5, 0x14, 0x31, 0x1a, 0x8d, 0x76, 0x2b, 0xf7, 0x66, 0x85,
+  0xcb, 0x78, 0x27, 0x1b, 0x28, 0xe9, 0x92, 0x5e, 0x32, 0xbc, 0x01, 0xaa, 0x0b, 0xf0, 0x91, 0x12,
+  0x4b, 0xff, 0xa2, 0xc8, 0xe8, 0x59, 0x8b, 0x25, 0x3a, 0x2e, 0x3b, 0x69, 0x4d, 0x7a, 0x3a, 0xf1,
+  0x3d, 0x85, 0xde, 0xdd, 0xb8, 0xa4, 0x7f, 0x50, 0x14, 0xd2, 0xa1, 0x2a, 0x3a, 0xc8, 0x81, 0x6d,
+  0xab, 0x62, 0xcb, 0xfb, 0x87, 0xa2, 0xf2, 0x81, 0xe5, 0xcd, 0x82, 0x18, 0x47, 0x1a, 0x6e, 0x45,
+  0xdb, 0xc5, 0x9a, 0x35, 0xf7, 0x8b, 0x07, 0x5e, 0x58, 0x11, 0x7d, 0x48, 0xec, 0xd0, 0xff, 0xd5,
+  0xf4, 0x89, 0xaf, 0xb7, 0x5d, 0x21, 0x4f, 0x62, 0xf9, 0x76, 0x25, 0x96, 0xc5, 0x33, 0x2f, 0xdc,
+  0x51, 0x91, 0x28, 0x1d, 0x4b, 0x6c, 0x85, 0x05, 0x37, 0x4f, 0x35, 0x77, 0x27, 0xac, 0xe8, 0x9d,
+  0xdf, 0xab, 0x38, 0x92, 0xca, 0x77, 0x4e, 0x0b, 0xf2, 0x1d, 0xaa, 0x00, 0xb1, 0x26, 0xc9, 0x93,
+  0xa8, 0xa4, 0x23, 0x72, 0x2e, 0x8d, 0xa3, 0x07, 0x5e, 0x06, 0x95, 0x62, 0xae, 0xf6, 0x78, 0x85,
+  0xb9, 0xbc, 0x44, 0x4c, 0xd9, 0xb6, 0xe0, 0xf4, 0x98, 0x35, 0xb3, 0xf7, 0xe6, 0x21, 0x8f, 0x0a,
+  0x86, 0x75, 0x28, 0x50, 0x38, 0x23, 0xe9, 0x7d, 0xc8, 0x23, 0x29, 0xf7, 0x7c, 0x9d, 0x85, 0x58,
+  0x7c, 0xfd, 0xf1, 0xed, 0x4e, 0xb4, 0x32, 0x44, 0x60, 0xbd, 0xd0, 0x32, 0xc9, 0x3c, 0x7d, 0xe1,
+  0x5a, 0xaa, 0x9a, 0xa1, 0x7e, 0x50, 0x00, 0x63, 0xb9, 0x72, 0x96, 0x67, 0x91, 0x33, 0xe3, 0x53,
+  0xd4, 0xcc, 0x39, 0x96, 0xff, 0x87, 0x2d, 0x62, 0x76, 0x07, 0x7d, 0x0a, 0x1f, 0x45, 0x80, 0xc6,
+  0xf7, 0x47, 0xc7, 0x07, 0x2c, 0x83, 0x2a, 0x05, 0x0b, 0x09, 0x48, 0x83, 0x19, 0x66, 0x06, 0x51,
+  0xa8, 0x5a, 0xba, 0xf9, 0xb9, 0xcb, 0xa8, 0x73, 0xcc, 0x7f, 0xa7, 0x69, 0xbe, 0x55, 0x7e, 0x76,
+  0x39, 0xa2, 0x3f, 0x3e, 0x26, 0xa8, 0x5a, 0x18, 0xdf, 0x92, 0xfd, 0x5b, 0x51, 0xcb, 0x48, 0x1e,
+  0x01, 0x1c, 0x89, 0xf9, 0x13, 0x3a, 0xe7, 0x8c, 0x9b, 0x4f, 0x89, 0x49, 0x91, 0xf8, 0x2e, 0x29,
+  0xdf, 0x00, 0x31, 0xb8, 0x44, 0xdd, 0x60, 0x12, 0x6f, 0x1d, 0xf6, 0x32, 0x17, 0x7a, 0xe0, 0x67,
+  0x8b, 0x91, 0x70, 0x80, 0x7e, 0xaf, 0x1a, 0xd3, 0x55, 0x39, 0xe4, 0xd7, 0xe1, 0x53, 0x4a, 0xc1,
+  0x3c, 0x76, 0x09, 0xc7, 0xf9, 0x10, 0x00, 0x45, 0x3e, 0x9c, 0xa8, 0x26, 0x8a, 0x11, 0x39, 0x0b,
+  0x2b, 0x8a, 0xdc, 0x78, 0xa4, 0xc8, 0x53, 0xf9, 0xae, 0x00, 0x1b, 0x91, 0x5e, 0xc5, 0xd2, 0xc5,
+  0xc5, 0x8a, 0x5b, 0xaf, 0x64, 0x0e, 0x2b, 0xc6, 0x19, 0x5d, 0x6d, 0x73, 0xe6, 0xc5, 0x7f, 0x52,
+  0x98, 0xf9, 0xc7, 0xb5, 0x05, 0x00, 0x00,
+};
+
+const AsyncWiFiManagerAsset WM_ASSETS[] = {
+  {"/wm-lock.png", "image/png", WM_ASSET_LOCK, sizeof(WM_ASSET_LOCK), "\"aa831698\"", false},
+  {"/wm.css", "text/css", WM_ASSET_CSS, sizeof(WM_ASSET_CSS), "\"b023fdce\"", true},
+  {"/wm.js", "application/javascript", WM_ASSET_JS, sizeof(WM_ASSET_JS), "\"8d7ec9d6\"", true},
+};
+
+const char HTTP_HEAD_ASSETS[] PROGMEM = "<link rel=\"stylesheet\" href=\"/wm.css?v=b023fdce\"><script src=\"/wm.js?v=8d7ec9d6\"></script>";
+
+#endif
@@ -0,0 +1,57 @@
+/**************************************************************
+   Compile time configuration of ESPAsyncWiFiManager.
+
+   Every WM_FEATURE_* switch defaults to the full library. Set one to 0 to
+   leave its routes, pages, PROGMEM strings and code out of the build, either
+   here or with a build flag (PlatformIO: build_flags = -DWM_FEATURE_INFO=0).
+   Defines in the sketch do not reach the library's own translation unit.
+   tools/size_table.py builds a sketch for each configuration and prints what
+   it costs in flash and RAM.
+ **************************************************************/
+
+#ifndef ESPAsyncWiFiManagerConfig_h
+#define ESPAsyncWiFiManagerConfig_h
+
+// stand alone mode: the stand_alone routes and pages, the button and state on
+// the options page and its NVS key
+#ifndef WM_FEATURE_STAND_ALONE
+#define WM_FEATURE_STAND_ALONE 1
+#endif
+
+// the pages as api calls on the station's network: setupApiCalls(),
+// staModeSetup() and the background scans they need
+#ifndef WM_FEATURE_STA_API
+#define WM_FEATURE_STA_API 1
+#endif
+
+// static IP fields on the config page and their parsing on save.
+// setSTAStaticIPConfig() keeps working without them
+#ifndef WM_FEATURE_STATIC_IP
+#define WM_FEATURE_STATIC_IP 1
+#endif
+
+// the info route and page, infoAsString() and infoAsJson()
+#ifndef WM_FEATURE_INFO
+#define WM_FEATURE_INFO 1
+#endif
+
+// duplicate SSID removal in the scan pipeline. Without it every BSSID is
+// listed and setRemoveDuplicateAPs() has no effect
+#ifndef WM_FEATURE_REMOVE_DUPLICATES
+#define WM_FEATURE_REMOVE_DUPLICATES 1
+#endif
+
+// WPS on the first connect without a password, off unless the older
+// NO_EXTRA_4K_HEAP switch asks for it. Only then is esp_wps.h included
+#ifndef WM_FEATURE_WPS
+#ifdef NO_EXTRA_4K_HEAP
+#define WM_FEATURE_WPS 1
+#else
+#define WM_FEATURE_WPS 0
+#endif
+#endif
+
+// Log strings are trimmed with WM_LOG_LEVEL (see ESPAsyncWiFiManager.h),
+// WM_LOG_NONE leaves none of them in flash
+
+#endif
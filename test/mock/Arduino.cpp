@@ -0,0 +1,142 @@
+#include "Arduino.h"
+#include <stdarg.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static unsigned long now = 0; // virtual clock, ms
+
+unsigned long millis()
+{
+  return now;
+}
+
+unsigned long micros()
+{
+  return now * 1000;
+}
+
+void delay(unsigned long ms)
+{
+  now += ms;
+}
+
+void yield()
+{
+}
+
+namespace mock
+{
+void advance(unsigned long ms)
+{
+  now += ms;
+}
+}
+
+long random(long max)
+{
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max)
+{
+  return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed)
+{
+  srand(seed);
+}
+
+std::string String::format(long value, unsigned char base)
+{
+  if (value < 0 && base == 10)
+  {
+    return "-" + format((unsigned long)-value, base);
+  }
+  return format((unsigned long)value, base);
+}
+
+std::string String::format(unsigned long value, unsigned char base)
+{
+  char buffer[8 * sizeof(value) + 1];
+  char *p = buffer + sizeof(buffer) - 1;
+  *p = '\0';
+  do
+  {
+    unsigned digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value != 0);
+  return p;
+}
+
+std::string String::format(double value, unsigned char decimals)
+{
+  char buffer[40];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  return buffer;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n < 0)
+  {
+    return 0;
+  }
+  return write((const uint8_t *)buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (echo)
+  {
+    fwrite(buffer, 1, size, stderr);
+  }
+  written += size;
+  return size;
+}
+
+bool IPAddress::fromString(const char *address)
+{
+  unsigned a, b, c, d;
+  char extra;
+  if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+  {
+    return false;
+  }
+  *this = IPAddress(a, b, c, d);
+  return true;
+}
+
+String IPAddress::toString() const
+{
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(buffer);
+}
+
+size_t IPAddress::printTo(Print &p) const
+{
+  return p.print(toString());
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  return 200000;
+}
+
+void EspClass::restart()
+{
+  restarts++;
+}
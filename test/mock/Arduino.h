@@ -0,0 +1,289 @@
+// Host stand-in for the Arduino core: String, Print, the clock and ESP.
+// Only what the library uses, behaving like the ESP32 core where it matters
+// for the pages. The clock is virtual, delay() advances it without sleeping.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+class String
+{
+public:
+  String(const char *cstr = "") : _s(cstr != NULL ? cstr : "") {}
+  String(const __FlashStringHelper *str) : _s(reinterpret_cast<const char *>(str)) {}
+  String(const String &other) : _s(other._s) {}
+  explicit String(char c) : _s(1, c) {}
+  explicit String(int value, unsigned char base = 10) : _s(format((long)value, base)) {}
+  explicit String(unsigned int value, unsigned char base = 10) : _s(format((unsigned long)value, base)) {}
+  explicit String(long value, unsigned char base = 10) : _s(format(value, base)) {}
+  explicit String(unsigned long value, unsigned char base = 10) : _s(format(value, base)) {}
+  explicit String(float value, unsigned char decimals = 2) : _s(format((double)value, decimals)) {}
+  explicit String(double value, unsigned char decimals = 2) : _s(format(value, decimals)) {}
+
+  String &operator=(const String &other)
+  {
+    _s = other._s;
+    return *this;
+  }
+  String &operator=(const char *cstr)
+  {
+    _s = cstr != NULL ? cstr : "";
+    return *this;
+  }
+
+  String &operator+=(const String &other)
+  {
+    _s += other._s;
+    return *this;
+  }
+  String &operator+=(const char *cstr)
+  {
+    _s += cstr != NULL ? cstr : "";
+    return *this;
+  }
+  String &operator+=(const __FlashStringHelper *str)
+  {
+    _s += reinterpret_cast<const char *>(str);
+    return *this;
+  }
+  String &operator+=(char c)
+  {
+    _s += c;
+    return *this;
+  }
+  String &operator+=(int value) { return *this += String(value); }
+  String &operator+=(unsigned int value) { return *this += String(value); }
+  String &operator+=(long value) { return *this += String(value); }
+  String &operator+=(unsigned long value) { return *this += String(value); }
+  bool concat(const char *cstr, unsigned int length)
+  {
+    _s.append(cstr, length);
+    return true;
+  }
+
+  bool operator==(const String &other) const { return _s == other._s; }
+  bool operator!=(const String &other) const { return _s != other._s; }
+  bool operator==(const char *cstr) const { return _s == cstr; }
+  bool operator!=(const char *cstr) const { return _s != cstr; }
+  bool equals(const String &other) const { return _s == other._s; }
+
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return _s.size(); }
+  bool isEmpty() const { return _s.empty(); }
+  bool reserve(unsigned int size)
+  {
+    _s.reserve(size);
+    return true;
+  }
+  char charAt(unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  int indexOf(char c, unsigned int from = 0) const { return find(_s.find(c, from)); }
+  int indexOf(const char *str, unsigned int from = 0) const { return find(_s.find(str, from)); }
+  int indexOf(const String &str, unsigned int from = 0) const { return find(_s.find(str._s, from)); }
+  bool startsWith(const String &prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+  String substring(unsigned int from, unsigned int to = (unsigned int)-1) const
+  {
+    if (from >= _s.size())
+    {
+      return String();
+    }
+    return String(_s.substr(from, std::min<size_t>(to, _s.size()) - from).c_str());
+  }
+  void toCharArray(char *buffer, unsigned int size) const
+  {
+    if (size == 0)
+    {
+      return;
+    }
+    strncpy(buffer, _s.c_str(), size - 1);
+    buffer[size - 1] = '\0';
+  }
+  long toInt() const { return atol(_s.c_str()); }
+
+  friend String operator+(const String &a, const String &b)
+  {
+    String r(a);
+    r += b;
+    return r;
+  }
+  friend String operator+(const String &a, const char *b)
+  {
+    String r(a);
+    r += b;
+    return r;
+  }
+  friend String operator+(const char *a, const String &b)
+  {
+    String r(a);
+    r += b;
+    return r;
+  }
+  friend String operator+(const String &a, const __FlashStringHelper *b)
+  {
+    String r(a);
+    r += b;
+    return r;
+  }
+  friend String operator+(const String &a, char b)
+  {
+    String r(a);
+    r += b;
+    return r;
+  }
+  friend String operator+(const String &a, int b) { return a + String(b); }
+  friend String operator+(const String &a, unsigned int b) { return a + String(b); }
+  friend String operator+(const String &a, long b) { return a + String(b); }
+  friend String operator+(const String &a, unsigned long b) { return a + String(b); }
+
+private:
+  std::string _s;
+
+  static int find(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+  static std::string format(long value, unsigned char base);
+  static std::string format(unsigned long value, unsigned char base);
+  static std::string format(double value, unsigned char decimals);
+};
+
+class Print;
+
+class Printable
+{
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+    {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+  size_t write(const char *str) { return str == NULL ? 0 : write((const uint8_t *)str, strlen(str)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+  size_t print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+  size_t print(const String &str) { return write(str.c_str(), str.length()); }
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(long long value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned long long value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+  size_t print(const Printable &x) { return x.printTo(*this); }
+
+  template <typename T>
+  size_t println(const T &value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T &value, int base) { return print(value, base) + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Serial output is kept out of the benchmark table unless asked for
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void flush() {}
+  int availableForWrite() { return 128; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+  boolean echo = false; // copy to stderr
+  size_t written = 0;
+};
+extern HardwareSerial Serial;
+
+class IPAddress : public Printable
+{
+public:
+  IPAddress() : _address(0) {}
+  IPAddress(uint32_t address) : _address(address) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : _address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+  operator uint32_t() const { return _address; }
+  uint8_t operator[](int index) const { return (_address >> (8 * index)) & 0xff; }
+  bool operator==(const IPAddress &other) const { return _address == other._address; }
+  bool fromString(const char *address);
+  bool fromString(const String &address) { return fromString(address.c_str()); }
+  String toString() const;
+  size_t printTo(Print &p) const override;
+
+private:
+  uint32_t _address;
+};
+
+class EspClass
+{
+public:
+  uint64_t getEfuseMac() { return 0x0000a1b2c3d4e5f6ULL; }
+  uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap() { return getFreeHeap(); }
+  uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+  uint32_t getCycleCount() { return (uint32_t)micros() * 240; }
+  void restart();
+
+  int restarts = 0;
+};
+extern EspClass ESP;
+
+#include "freertos/FreeRTOS.h"
+
+// host control of the mocks
+namespace mock
+{
+void advance(unsigned long ms);
+}
@@ -0,0 +1,70 @@
+#include "ArduinoNvs.h"
+
+ArduinoNvs NVS;
+
+bool ArduinoNvs::begin(String ns)
+{
+  (void)ns;
+  return true;
+}
+
+bool ArduinoNvs::setInt(String key, int64_t value, bool forceCommit)
+{
+  return setBlob(key, (uint8_t *)&value, sizeof(value), forceCommit);
+}
+
+bool ArduinoNvs::setString(String key, String value, bool forceCommit)
+{
+  return setBlob(key, (uint8_t *)value.c_str(), value.length() + 1, forceCommit);
+}
+
+bool ArduinoNvs::setBlob(String key, uint8_t *blob, size_t length, bool forceCommit)
+{
+  entries[key.c_str()].assign(blob, blob + length);
+  return forceCommit ? commit() : true;
+}
+
+int64_t ArduinoNvs::getInt(String key, int64_t default_value)
+{
+  int64_t value;
+  return getBlob(key, (uint8_t *)&value, sizeof(value)) ? value : default_value;
+}
+
+String ArduinoNvs::getString(String key)
+{
+  std::map<std::string, std::vector<uint8_t> >::iterator it = entries.find(key.c_str());
+  if (it == entries.end() || it->second.empty())
+  {
+    return String();
+  }
+  return String((const char *)it->second.data());
+}
+
+bool ArduinoNvs::getBlob(String key, uint8_t *blob, size_t length)
+{
+  std::map<std::string, std::vector<uint8_t> >::iterator it = entries.find(key.c_str());
+  if (it == entries.end() || it->second.size() != length)
+  {
+    return false;
+  }
+  memcpy(blob, it->second.data(), length);
+  return true;
+}
+
+size_t ArduinoNvs::getBlobSize(String key)
+{
+  std::map<std::string, std::vector<uint8_t> >::iterator it = entries.find(key.c_str());
+  return it == entries.end() ? 0 : it->second.size();
+}
+
+bool ArduinoNvs::erase(String key, bool forceCommit)
+{
+  entries.erase(key.c_str());
+  return forceCommit ? commit() : true;
+}
+
+bool ArduinoNvs::commit()
+{
+  commits++;
+  return true;
+}
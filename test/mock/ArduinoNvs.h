@@ -0,0 +1,30 @@
+// Host stand-in for ArduinoNvs, a map in RAM that counts its commits
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class ArduinoNvs
+{
+public:
+  bool begin(String ns = "storage");
+  bool setInt(String key, uint8_t value, bool forceCommit = true) { return setInt(key, (int64_t)value, forceCommit); }
+  bool setInt(String key, int16_t value, bool forceCommit = true) { return setInt(key, (int64_t)value, forceCommit); }
+  bool setInt(String key, uint16_t value, bool forceCommit = true) { return setInt(key, (int64_t)value, forceCommit); }
+  bool setInt(String key, int32_t value, bool forceCommit = true) { return setInt(key, (int64_t)value, forceCommit); }
+  bool setInt(String key, uint32_t value, bool forceCommit = true) { return setInt(key, (int64_t)value, forceCommit); }
+  bool setInt(String key, int64_t value, bool forceCommit = true);
+  bool setString(String key, String value, bool forceCommit = true);
+  bool setBlob(String key, uint8_t *blob, size_t length, bool forceCommit = true);
+  int64_t getInt(String key, int64_t default_value = 0);
+  String getString(String key);
+  bool getBlob(String key, uint8_t *blob, size_t length);
+  size_t getBlobSize(String key);
+  bool erase(String key, bool forceCommit = true);
+  bool commit();
+
+  // host side
+  std::map<std::string, std::vector<uint8_t> > entries;
+  int commits = 0;
+};
+extern ArduinoNvs NVS;
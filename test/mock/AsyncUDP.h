@@ -0,0 +1,29 @@
+// Host stand-in for AsyncUDP, no packets ever arrive
+#pragma once
+#include <Arduino.h>
+
+class AsyncUDPPacket
+{
+public:
+  uint8_t *data() { return NULL; }
+  size_t length() { return 0; }
+  size_t write(const uint8_t *data, size_t len)
+  {
+    (void)data;
+    return len;
+  }
+};
+
+typedef std::function<void(AsyncUDPPacket &packet)> AuPacketHandlerFunction;
+
+class AsyncUDP
+{
+public:
+  bool listen(uint16_t port)
+  {
+    (void)port;
+    return true;
+  }
+  void onPacket(AuPacketHandlerFunction cb) { (void)cb; }
+  void close() {}
+};
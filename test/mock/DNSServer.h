@@ -0,0 +1,23 @@
+// Host stand-in for DNSServer, no queries ever arrive
+#pragma once
+#include <Arduino.h>
+
+enum class DNSReplyCode
+{
+  NoError = 0
+};
+
+class DNSServer
+{
+public:
+  void processNextRequest() {}
+  void setErrorReplyCode(const DNSReplyCode &code) { (void)code; }
+  bool start(const uint16_t &port, const String &domainName, const IPAddress &resolvedIP)
+  {
+    (void)port;
+    (void)domainName;
+    (void)resolvedIP;
+    return true;
+  }
+  void stop() {}
+};
@@ -0,0 +1,257 @@
+#include "ESPAsyncWebServer.h"
+
+static const String emptyString;
+
+size_t AsyncBasicResponse::fill(uint8_t *buffer, size_t maxLen, size_t index)
+{
+  if (index >= _content.size())
+  {
+    return 0;
+  }
+  size_t n = std::min(maxLen, _content.size() - index);
+  memcpy(buffer, _content.data() + index, n);
+  return n;
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(const char *url, WebRequestMethodComposite method)
+    : _url(url), _host("192.168.4.1"), _method(method)
+{
+  _client._localIP = IPAddress(192, 168, 4, 1);
+}
+
+// like the server, the response goes away and the disconnect handler runs
+// when the request is done with
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+  delete _response;
+  if (_onDisconnect)
+  {
+    _onDisconnect();
+  }
+  for (size_t i = 0; i < _params.size(); i++)
+  {
+    delete _params[i];
+  }
+  for (size_t i = 0; i < _headers.size(); i++)
+  {
+    delete _headers[i];
+  }
+}
+
+bool AsyncWebServerRequest::hasArg(const char *name) const
+{
+  return getParam(String(name)) != NULL || getParam(String(name), true) != NULL;
+}
+
+const String &AsyncWebServerRequest::arg(const String &name) const
+{
+  for (size_t i = 0; i < _params.size(); i++)
+  {
+    if (_params[i]->name() == name)
+    {
+      return _params[i]->value();
+    }
+  }
+  return emptyString;
+}
+
+const String &AsyncWebServerRequest::arg(size_t i) const
+{
+  return i < _params.size() ? _params[i]->value() : emptyString;
+}
+
+const String &AsyncWebServerRequest::argName(size_t i) const
+{
+  return i < _params.size() ? _params[i]->name() : emptyString;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(size_t i) const
+{
+  return i < _params.size() ? _params[i] : NULL;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file) const
+{
+  (void)file;
+  for (size_t i = 0; i < _params.size(); i++)
+  {
+    if (_params[i]->name() == name && _params[i]->isPost() == post)
+    {
+      return _params[i];
+    }
+  }
+  return NULL;
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const
+{
+  return getParam(name, post, file) != NULL;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String &name) const
+{
+  return getHeader(name) != NULL;
+}
+
+AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name) const
+{
+  for (size_t i = 0; i < _headers.size(); i++)
+  {
+    if (strcasecmp(_headers[i]->name().c_str(), name.c_str()) == 0)
+    {
+      return _headers[i];
+    }
+  }
+  return NULL;
+}
+
+const String &AsyncWebServerRequest::header(const char *name) const
+{
+  AsyncWebHeader *h = getHeader(String(name));
+  return h != NULL ? h->value() : emptyString;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+  delete _response;
+  _response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+  send(beginResponse(code, contentType, content));
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content)
+{
+  return new AsyncBasicResponse(code, contentType, (const uint8_t *)content.c_str(), content.length());
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len)
+{
+  return new AsyncBasicResponse(code, contentType, content, len);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType, AwsResponseFiller callback)
+{
+  return new AsyncChunkedResponse(contentType, callback);
+}
+
+void AsyncWebServerRequest::addParam(const String &name, const String &value, bool post)
+{
+  _params.push_back(new AsyncWebParameter(name, value, post));
+}
+
+void AsyncWebServerRequest::addHeader(const String &name, const String &value)
+{
+  _headers.push_back(new AsyncWebHeader(name, value));
+}
+
+size_t AsyncWebServerRequest::drain(size_t mss, std::string *body)
+{
+  if (_response == NULL)
+  {
+    return 0;
+  }
+  std::vector<uint8_t> buffer(mss);
+  size_t index = 0;
+  for (;;)
+  {
+    size_t n = _response->fill(buffer.data(), mss, index);
+    if (n == RESPONSE_TRY_AGAIN)
+    {
+      continue;
+    }
+    if (n == 0)
+    {
+      return index;
+    }
+    if (body != NULL)
+    {
+      body->append((const char *)buffer.data(), n);
+    }
+    index += n;
+  }
+}
+
+bool ON_AP_FILTER(AsyncWebServerRequest *request)
+{
+  return request->client()->localIP() == IPAddress(192, 168, 4, 1);
+}
+
+bool ON_STA_FILTER(AsyncWebServerRequest *request)
+{
+  return !ON_AP_FILTER(request);
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request)
+{
+  return (_method & request->method()) != 0 && request->url() == _uri;
+}
+
+void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect)
+{
+  (void)message;
+  (void)event;
+  (void)id;
+  (void)reconnect;
+}
+
+void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect)
+{
+  (void)message;
+  (void)event;
+  (void)id;
+  (void)reconnect;
+  sent++;
+}
+
+// the server owns its handlers, as in the library both reset() and
+// removeHandler() delete them
+void AsyncWebServer::reset()
+{
+  for (std::list<AsyncWebHandler *>::iterator it = _handlers.begin(); it != _handlers.end(); ++it)
+  {
+    delete *it;
+  }
+  _handlers.clear();
+  _notFound = ArRequestHandlerFunction();
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest)
+{
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest);
+  _handlers.push_back(handler);
+  return *handler;
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler)
+{
+  _handlers.push_back(handler);
+  return *handler;
+}
+
+bool AsyncWebServer::removeHandler(AsyncWebHandler *handler)
+{
+  _handlers.remove(handler);
+  delete handler;
+  return true;
+}
+
+void AsyncWebServer::handle(AsyncWebServerRequest *request)
+{
+  for (std::list<AsyncWebHandler *>::iterator it = _handlers.begin(); it != _handlers.end(); ++it)
+  {
+    if ((*it)->filter(request) && (*it)->canHandle(request))
+    {
+      request->handled = true;
+      (*it)->handleRequest(request);
+      return;
+    }
+  }
+  if (_notFound)
+  {
+    request->handled = true;
+    _notFound(request);
+  }
+}
@@ -0,0 +1,247 @@
+// Host stand-in for ESPAsyncWebServer. Requests are built by the harness,
+// AsyncWebServer::handle() runs the matching handler and
+// AsyncWebServerRequest::drain() pulls the response the way the TCP side
+// would: chunked fillers are called with MSS sized buffers until they
+// return 0.
+#pragma once
+#include <Arduino.h>
+#include <list>
+#include <memory>
+#include <vector>
+
+typedef enum
+{
+  HTTP_GET = 1,
+  HTTP_POST = 2,
+  HTTP_DELETE = 4,
+  HTTP_PUT = 8,
+  HTTP_PATCH = 16,
+  HTTP_HEAD = 32,
+  HTTP_OPTIONS = 64,
+  HTTP_ANY = 127
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t *, size_t, size_t)> AwsResponseFiller;
+
+class AsyncClient
+{
+public:
+  IPAddress localIP() { return _localIP; }
+  IPAddress remoteIP() { return IPAddress(192, 168, 4, 2); }
+
+  IPAddress _localIP;
+};
+
+class AsyncWebParameter
+{
+public:
+  AsyncWebParameter(const String &name, const String &value, bool post) : _name(name), _value(value), _post(post) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+  bool isPost() const { return _post; }
+  bool isFile() const { return false; }
+
+private:
+  String _name;
+  String _value;
+  bool _post;
+};
+
+class AsyncWebHeader
+{
+public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+private:
+  String _name;
+  String _value;
+};
+
+class AsyncWebServerResponse
+{
+public:
+  AsyncWebServerResponse(int code, const String &contentType) : code(code), contentType(contentType) {}
+  virtual ~AsyncWebServerResponse() {}
+  void addHeader(const String &name, const String &value) { headers.push_back(AsyncWebHeader(name, value)); }
+  void setCode(int c) { code = c; }
+  // the body as the client would receive it, chunk by chunk
+  virtual size_t fill(uint8_t *buffer, size_t maxLen, size_t index) = 0;
+
+  int code;
+  String contentType;
+  std::vector<AsyncWebHeader> headers;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse
+{
+public:
+  AsyncBasicResponse(int code, const String &contentType, const uint8_t *content, size_t length)
+      : AsyncWebServerResponse(code, contentType), _content((const char *)content, length) {}
+  size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override;
+
+private:
+  std::string _content;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse
+{
+public:
+  AsyncChunkedResponse(const String &contentType, AwsResponseFiller filler)
+      : AsyncWebServerResponse(200, contentType), _filler(filler) {}
+  size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override { return _filler(buffer, maxLen, index); }
+
+private:
+  AwsResponseFiller _filler;
+};
+
+typedef std::function<void(void)> ArDisconnectHandler;
+
+class AsyncWebServerRequest
+{
+public:
+  AsyncWebServerRequest(const char *url, WebRequestMethodComposite method = HTTP_GET);
+  ~AsyncWebServerRequest();
+
+  AsyncClient *client() { return &_client; }
+  String url() const { return _url; }
+  String host() const { return _host; }
+  WebRequestMethodComposite method() const { return _method; }
+
+  bool hasArg(const char *name) const;
+  const String &arg(const String &name) const;
+  const String &arg(size_t i) const;
+  const String &argName(size_t i) const;
+  size_t args() const { return _params.size(); }
+  size_t params() const { return _params.size(); }
+  AsyncWebParameter *getParam(size_t i) const;
+  AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const;
+  bool hasParam(const String &name, bool post = false, bool file = false) const;
+
+  bool hasHeader(const String &name) const;
+  AsyncWebHeader *getHeader(const String &name) const;
+  const String &header(const char *name) const;
+
+  void send(AsyncWebServerResponse *response);
+  void send(int code, const String &contentType = String(), const String &content = String());
+  AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+  AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len);
+  AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback);
+  void onDisconnect(ArDisconnectHandler fn) { _onDisconnect = fn; }
+
+  // host side
+  void addParam(const String &name, const String &value, bool post = false);
+  void addHeader(const String &name, const String &value);
+  void setHost(const String &host) { _host = host; }
+  void setLocalIP(IPAddress ip) { _client._localIP = ip; }
+  // runs the fillers until the body is complete, returns its length.
+  // body receives it when not NULL
+  size_t drain(size_t mss, std::string *body);
+  AsyncWebServerResponse *response() { return _response; }
+  boolean handled = false;
+
+private:
+  String _url;
+  String _host;
+  WebRequestMethodComposite _method;
+  AsyncClient _client;
+  std::vector<AsyncWebParameter *> _params;
+  std::vector<AsyncWebHeader *> _headers;
+  AsyncWebServerResponse *_response = NULL;
+  ArDisconnectHandler _onDisconnect;
+};
+
+typedef std::function<bool(AsyncWebServerRequest *)> ArRequestFilterFunction;
+bool ON_AP_FILTER(AsyncWebServerRequest *request);
+bool ON_STA_FILTER(AsyncWebServerRequest *request);
+
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+
+class AsyncWebHandler
+{
+public:
+  virtual ~AsyncWebHandler() {}
+  AsyncWebHandler &setFilter(ArRequestFilterFunction fn)
+  {
+    _filter = fn;
+    return *this;
+  }
+  bool filter(AsyncWebServerRequest *request) { return !_filter || _filter(request); }
+  virtual bool canHandle(AsyncWebServerRequest *request) = 0;
+  virtual void handleRequest(AsyncWebServerRequest *request) = 0;
+
+protected:
+  ArRequestFilterFunction _filter;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+public:
+  AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn)
+      : _uri(uri), _method(method), _fn(fn) {}
+  AsyncCallbackWebHandler &setFilter(ArRequestFilterFunction fn)
+  {
+    AsyncWebHandler::setFilter(fn);
+    return *this;
+  }
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override { _fn(request); }
+
+private:
+  String _uri;
+  WebRequestMethodComposite _method;
+  ArRequestHandlerFunction _fn;
+};
+
+class AsyncEventSourceClient
+{
+public:
+  void send(const char *message, const char *event = NULL, uint32_t id = 0, uint32_t reconnect = 0);
+  uint32_t lastId() const { return 0; }
+};
+
+typedef std::function<void(AsyncEventSourceClient *)> ArEventHandlerFunction;
+
+// no client ever connects, events are only counted
+class AsyncEventSource : public AsyncWebHandler
+{
+public:
+  AsyncEventSource(const String &url) : _url(url) {}
+  void onConnect(ArEventHandlerFunction fn) { _onConnect = fn; }
+  void send(const char *message, const char *event = NULL, uint32_t id = 0, uint32_t reconnect = 0);
+  size_t count() const { return 0; }
+  void close() {}
+  bool canHandle(AsyncWebServerRequest *request) override { return request->url() == _url; }
+  void handleRequest(AsyncWebServerRequest *request) override { request->send(200, "text/event-stream", ""); }
+
+  size_t sent = 0;
+
+private:
+  String _url;
+  ArEventHandlerFunction _onConnect;
+};
+
+class AsyncWebServer
+{
+public:
+  AsyncWebServer(uint16_t port) { (void)port; }
+  ~AsyncWebServer() { reset(); }
+  void begin() {}
+  void reset();
+  AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest) { return on(uri, HTTP_ANY, onRequest); }
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+  void onNotFound(ArRequestHandlerFunction fn) { _notFound = fn; }
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+  bool removeHandler(AsyncWebHandler *handler);
+
+  // host side: route the request, run its handler and send the response
+  void handle(AsyncWebServerRequest *request);
+
+private:
+  std::list<AsyncWebHandler *> _handlers;
+  ArRequestHandlerFunction _notFound;
+};
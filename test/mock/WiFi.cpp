@@ -0,0 +1,249 @@
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::status()
+{
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::mode(wifi_mode_t m)
+{
+  currentMode = m;
+  return true;
+}
+
+wifi_mode_t WiFiClass::getMode()
+{
+  return currentMode;
+}
+
+bool WiFiClass::persistent(bool persistent)
+{
+  (void)persistent;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap)
+{
+  (void)wifioff;
+  (void)eraseap;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass, int32_t channel, const uint8_t *bssid, bool connect)
+{
+  (void)ssid;
+  (void)pass;
+  (void)channel;
+  (void)bssid;
+  (void)connect;
+  return WL_DISCONNECTED;
+}
+
+wl_status_t WiFiClass::begin()
+{
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
+{
+  (void)local_ip;
+  (void)gateway;
+  (void)subnet;
+  (void)dns1;
+  (void)dns2;
+  return true;
+}
+
+bool WiFiClass::softAP(const char *ssid, const char *passphrase, int channel, int ssid_hidden, int max_connection)
+{
+  (void)ssid;
+  (void)passphrase;
+  (void)channel;
+  (void)ssid_hidden;
+  (void)max_connection;
+  return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet)
+{
+  (void)local_ip;
+  (void)gateway;
+  (void)subnet;
+  return true;
+}
+
+IPAddress WiFiClass::softAPIP()
+{
+  return IPAddress(192, 168, 4, 1);
+}
+
+String WiFiClass::softAPmacAddress()
+{
+  return String("A2:B2:C3:D4:E5:F6");
+}
+
+uint8_t WiFiClass::softAPgetStationNum()
+{
+  return stations;
+}
+
+String WiFiClass::SSID() const
+{
+  return String();
+}
+
+String WiFiClass::SSID(uint8_t i)
+{
+  return i < networks.size() ? String(networks[i].ssid) : String();
+}
+
+String WiFiClass::psk() const
+{
+  return String();
+}
+
+uint8_t *WiFiClass::BSSID()
+{
+  return NULL;
+}
+
+int32_t WiFiClass::channel()
+{
+  return 1;
+}
+
+int32_t WiFiClass::channel(uint8_t i)
+{
+  return i < networks.size() ? networks[i].channel : 0;
+}
+
+int32_t WiFiClass::RSSI(uint8_t i)
+{
+  return i < networks.size() ? networks[i].rssi : 0;
+}
+
+int8_t WiFiClass::RSSI()
+{
+  return 0;
+}
+
+wifi_auth_mode_t WiFiClass::encryptionType(uint8_t i)
+{
+  return i < networks.size() ? networks[i].auth : WIFI_AUTH_OPEN;
+}
+
+uint8_t *WiFiClass::BSSID(uint8_t i)
+{
+  return i < networks.size() ? networks[i].bssid : NULL;
+}
+
+IPAddress WiFiClass::localIP()
+{
+  return IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+  return IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+  return IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t i)
+{
+  (void)i;
+  return IPAddress();
+}
+
+String WiFiClass::macAddress()
+{
+  return String("A0:B2:C3:D4:E5:F6");
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+  static const uint8_t address[6] = {0xa0, 0xb2, 0xc3, 0xd4, 0xe5, 0xf6};
+  memcpy(mac, address, sizeof(address));
+  return mac;
+}
+
+uint8_t *WiFiClass::softAPmacAddress(uint8_t *mac)
+{
+  macAddress(mac);
+  mac[0] = 0xa2;
+  return mac;
+}
+
+// scans complete at once, async or not
+int16_t WiFiClass::scanNetworks(bool async, bool show_hidden, bool passive, uint32_t max_ms_per_chan)
+{
+  (void)async;
+  (void)show_hidden;
+  (void)passive;
+  (void)max_ms_per_chan;
+  scanState = networks.size();
+  return scanState;
+}
+
+int16_t WiFiClass::scanComplete()
+{
+  return scanState;
+}
+
+void WiFiClass::scanDelete()
+{
+  scanState = WIFI_SCAN_FAILED;
+}
+
+bool WiFiClass::getNetworkInfo(uint8_t i, String &ssid, uint8_t &encryptionType, int32_t &RSSI, uint8_t *&BSSID, int32_t &channel)
+{
+  if (i >= networks.size())
+  {
+    return false;
+  }
+  ssid = networks[i].ssid;
+  encryptionType = networks[i].auth;
+  RSSI = networks[i].rssi;
+  BSSID = networks[i].bssid;
+  channel = networks[i].channel;
+  return true;
+}
+
+int WiFiClass::waitForConnectResult()
+{
+  return WL_DISCONNECTED;
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb cb, system_event_id_t event)
+{
+  (void)cb;
+  (void)event;
+  return 1;
+}
+
+void WiFiClass::removeEvent(wifi_event_id_t id)
+{
+  (void)id;
+}
+
+bool WiFiClass::setSleep(bool enable)
+{
+  (void)enable;
+  return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool autoReconnect)
+{
+  (void)autoReconnect;
+  return true;
+}
+
+bool WiFiClass::getAutoReconnect()
+{
+  return false;
+}
@@ -0,0 +1,96 @@
+// Host stand-in for the ESP32 WiFi class. Scans find whatever the harness put
+// in networks, connections never come up.
+#pragma once
+#include <Arduino.h>
+#include <vector>
+typedef enum { WL_NO_SHIELD = 255, WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED, WL_CONNECTION_LOST, WL_DISCONNECTED } wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+typedef enum { WIFI_AUTH_OPEN = 0, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK } wifi_auth_mode_t;
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+typedef enum {
+  SYSTEM_EVENT_WIFI_READY = 0, SYSTEM_EVENT_SCAN_DONE, SYSTEM_EVENT_STA_START, SYSTEM_EVENT_STA_STOP,
+  SYSTEM_EVENT_STA_CONNECTED, SYSTEM_EVENT_STA_DISCONNECTED, SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+  SYSTEM_EVENT_STA_GOT_IP, SYSTEM_EVENT_STA_LOST_IP, SYSTEM_EVENT_AP_START, SYSTEM_EVENT_AP_STOP,
+  SYSTEM_EVENT_AP_STACONNECTED, SYSTEM_EVENT_AP_STADISCONNECTED, SYSTEM_EVENT_MAX
+} system_event_id_t;
+typedef enum {
+  WIFI_REASON_UNSPECIFIED = 1, WIFI_REASON_AUTH_EXPIRE = 2, WIFI_REASON_AUTH_LEAVE = 3, WIFI_REASON_ASSOC_EXPIRE = 4,
+  WIFI_REASON_ASSOC_LEAVE = 8, WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT = 15, WIFI_REASON_802_1X_AUTH_FAILED = 23,
+  WIFI_REASON_BEACON_TIMEOUT = 200, WIFI_REASON_NO_AP_FOUND = 201, WIFI_REASON_AUTH_FAIL = 202,
+  WIFI_REASON_ASSOC_FAIL = 203, WIFI_REASON_HANDSHAKE_TIMEOUT = 204
+} wifi_err_reason_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t channel; } system_event_sta_connected_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t reason; } system_event_sta_disconnected_t;
+typedef struct { uint32_t addr; } ip4_addr_t;
+typedef struct { ip4_addr_t ip; ip4_addr_t netmask; ip4_addr_t gw; } tcpip_adapter_ip_info_t;
+typedef struct { tcpip_adapter_ip_info_t ip_info; bool ip_changed; } system_event_sta_got_ip_t;
+typedef struct { uint32_t status; uint8_t number; uint8_t scan_id; } system_event_sta_scan_done_t;
+typedef union {
+  system_event_sta_connected_t connected;
+  system_event_sta_disconnected_t disconnected;
+  system_event_sta_got_ip_t got_ip;
+  system_event_sta_scan_done_t scan_done;
+} system_event_info_t;
+typedef system_event_id_t WiFiEvent_t;
+typedef system_event_info_t WiFiEventInfo_t;
+typedef std::function<void(system_event_id_t, system_event_info_t)> WiFiEventFuncCb;
+typedef size_t wifi_event_id_t;
+class WiFiClass {
+public:
+  wl_status_t status();
+  bool mode(wifi_mode_t);
+  wifi_mode_t getMode();
+  bool persistent(bool);
+  bool disconnect(bool wifioff = false, bool eraseap = false);
+  wl_status_t begin(const char *ssid, const char *pass = NULL, int32_t channel = 0, const uint8_t *bssid = NULL, bool connect = true);
+  wl_status_t begin();
+  bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0, IPAddress dns2 = (uint32_t)0);
+  bool softAP(const char *ssid, const char *passphrase = NULL, int channel = 1, int ssid_hidden = 0, int max_connection = 4);
+  bool softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet);
+  IPAddress softAPIP();
+  String softAPmacAddress();
+  uint8_t softAPgetStationNum();
+  String SSID() const;
+  String SSID(uint8_t i);
+  String psk() const;
+  uint8_t *BSSID();
+  int32_t channel();
+  int32_t channel(uint8_t i);
+  int32_t RSSI(uint8_t i);
+  int8_t RSSI();
+  wifi_auth_mode_t encryptionType(uint8_t i);
+  uint8_t *BSSID(uint8_t i);
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t i = 0);
+  String macAddress();
+  uint8_t *macAddress(uint8_t *);
+  uint8_t *softAPmacAddress(uint8_t *);
+  int16_t scanNetworks(bool async = false, bool show_hidden = false, bool passive = false, uint32_t max_ms_per_chan = 300);
+  int16_t scanComplete();
+  void scanDelete();
+  bool getNetworkInfo(uint8_t i, String &ssid, uint8_t &encryptionType, int32_t &RSSI, uint8_t *&BSSID, int32_t &channel);
+  int waitForConnectResult();
+  wifi_event_id_t onEvent(WiFiEventFuncCb, system_event_id_t event = SYSTEM_EVENT_MAX);
+  void removeEvent(wifi_event_id_t);
+  bool setSleep(bool);
+  bool setAutoReconnect(bool);
+  bool getAutoReconnect();
+
+  // host side
+  struct Network
+  {
+    char ssid[33];
+    uint8_t bssid[6];
+    int32_t rssi;
+    int32_t channel;
+    wifi_auth_mode_t auth;
+  };
+  std::vector<Network> networks;
+  uint8_t stations = 0; // attached to the soft AP
+  wifi_mode_t currentMode = WIFI_OFF;
+  int16_t scanState = WIFI_SCAN_FAILED;
+};
+extern WiFiClass WiFi;
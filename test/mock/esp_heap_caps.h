@@ -0,0 +1,5 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_8BIT 4
+size_t heap_caps_get_largest_free_block(uint32_t caps);
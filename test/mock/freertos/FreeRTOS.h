@@ -0,0 +1,52 @@
+// Host stand-in for the FreeRTOS calls the library makes. The harness is
+// single threaded: no task is ever created and critical sections are empty.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+typedef void *TaskHandle_t;
+typedef void *EventGroupHandle_t;
+typedef void *RingbufHandle_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffff
+#define pdMS_TO_TICKS(x) (x)
+#define tskNO_AFFINITY 0x7fffffff
+#define tskIDLE_PRIORITY 0
+
+typedef struct
+{
+  int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(m) (void)(m)
+#define portEXIT_CRITICAL(m) (void)(m)
+
+EventGroupHandle_t xEventGroupCreate();
+void vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t wait);
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task, BaseType_t core);
+BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *task);
+void vTaskDelete(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+#define RINGBUF_TYPE_NOSPLIT 0
+RingbufHandle_t xRingbufferCreate(size_t size, int type);
+void vRingbufferDelete(RingbufHandle_t buffer);
+BaseType_t xRingbufferSend(RingbufHandle_t buffer, const void *item, size_t size, TickType_t wait);
+void *xRingbufferReceive(RingbufHandle_t buffer, size_t *size, TickType_t wait);
+void vRingbufferReturnItem(RingbufHandle_t buffer, void *item);
@@ -0,0 +1,3 @@
+// the application's NVS keys, the library includes them from its include/
+#pragma once
+#define NVS_STAND_ALONE "stand_alone"
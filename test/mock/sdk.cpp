@@ -0,0 +1,211 @@
+// The SDK calls of the library: FreeRTOS, esp_timer, the watchdog, the heap
+// and the captive DNS transports. Nothing runs concurrently on the host.
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include <DNSServer.h>
+#include <esp_heap_caps.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <freertos/event_groups.h>
+#include <freertos/ringbuf.h>
+#include <list>
+
+EventGroupHandle_t xEventGroupCreate()
+{
+  return new EventBits_t(0);
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+  delete (EventBits_t *)group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+  return *(EventBits_t *)group |= bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+  EventBits_t before = *(EventBits_t *)group;
+  *(EventBits_t *)group &= ~bits;
+  return before;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t wait)
+{
+  (void)all;
+  EventBits_t set = *(EventBits_t *)group;
+  if ((set & bits) == 0)
+  {
+    delay(wait); // nothing else can set them, the wait runs out
+  }
+  if (clear)
+  {
+    *(EventBits_t *)group &= ~bits;
+  }
+  return set;
+}
+
+// no tasks, the library then runs everything from loop()
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task, BaseType_t core)
+{
+  (void)fn;
+  (void)name;
+  (void)stack;
+  (void)arg;
+  (void)priority;
+  (void)task;
+  (void)core;
+  return pdFAIL;
+}
+
+BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *task)
+{
+  return xTaskCreatePinnedToCore(fn, name, stack, arg, priority, task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  (void)task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+  (void)clear;
+  delay(wait);
+  return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  (void)task;
+  return pdPASS;
+}
+
+static int mainTask;
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return &mainTask;
+}
+
+RingbufHandle_t xRingbufferCreate(size_t size, int type)
+{
+  (void)size;
+  (void)type;
+  return NULL;
+}
+
+void vRingbufferDelete(RingbufHandle_t buffer)
+{
+  (void)buffer;
+}
+
+BaseType_t xRingbufferSend(RingbufHandle_t buffer, const void *item, size_t size, TickType_t wait)
+{
+  (void)buffer;
+  (void)item;
+  (void)size;
+  (void)wait;
+  return pdFALSE;
+}
+
+void *xRingbufferReceive(RingbufHandle_t buffer, size_t *size, TickType_t wait)
+{
+  (void)buffer;
+  (void)size;
+  (void)wait;
+  return NULL;
+}
+
+void vRingbufferReturnItem(RingbufHandle_t buffer, void *item)
+{
+  (void)buffer;
+  (void)item;
+}
+
+struct esp_timer
+{
+  esp_timer_create_args_t args;
+  bool armed;
+  unsigned long due;
+};
+
+static std::list<esp_timer *> timers;
+
+int64_t esp_timer_get_time()
+{
+  return micros();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+  esp_timer *timer = new esp_timer();
+  timer->args = *args;
+  timer->armed = false;
+  timers.push_back(timer);
+  *out = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+  if (timer->armed)
+  {
+    return ESP_FAIL;
+  }
+  timer->armed = true;
+  timer->due = millis() + (timeout_us + 999) / 1000;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  if (!timer->armed)
+  {
+    return ESP_FAIL;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+  timers.remove(timer);
+  delete timer;
+  return ESP_OK;
+}
+
+namespace mock
+{
+void fireTimers()
+{
+  std::list<esp_timer *> due;
+  for (std::list<esp_timer *>::iterator it = timers.begin(); it != timers.end(); ++it)
+  {
+    if ((*it)->armed && (long)(millis() - (*it)->due) >= 0)
+    {
+      (*it)->armed = false;
+      due.push_back(*it);
+    }
+  }
+  for (std::list<esp_timer *>::iterator it = due.begin(); it != due.end(); ++it)
+  {
+    (*it)->args.callback((*it)->args.arg);
+  }
+}
+}
+
+esp_err_t esp_task_wdt_reset()
+{
+  return ESP_OK;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+  (void)caps;
+  return ESP.getFreeHeap();
+}
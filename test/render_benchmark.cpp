@@ -0,0 +1,274 @@
+// Host regression harness for the scan pipeline and the page renderers.
+//
+// Builds the library against the mocks in test/mock and drives it through
+// its public API only: a modeless portal on a mocked soft AP, synthetic scans
+// of 0 to 100 networks and 0 to 30 custom parameters, requests sent to the
+// mocked web server. Prints one line per case:
+//
+//   aps params case us_per_call bytes allocs_per_call peak_bytes leaked_bytes
+//
+// allocs_per_call counts operator new calls, peak_bytes is the most heap a
+// call held above what was allocated before it, leaked_bytes what the calls
+// left allocated (for the String returning cases while the String is still
+// alive). Run it before and after a change to the render or scan code and
+// compare the lines.
+//
+// It exits non-zero when a page fails: no 200, an empty body, a body that
+// differs with the chunk size, or custom parameters missing from the form.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <ESPAsyncWiFiManager.h>
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#define ITERATIONS 20
+#define MAX_APS 100
+#define MAX_PARAMS 30
+#define MSS 1436 // a TCP segment on the ESP32's lwIP
+#define SMALL_MSS 97 // chunks that end anywhere in the page
+
+// heap accounting, every allocation carries its size in front of it
+static size_t allocations = 0;
+static size_t liveBytes = 0;
+static size_t peakBytes = 0;
+
+struct alignas(std::max_align_t) AllocationHeader
+{
+  size_t size;
+};
+
+void *operator new(size_t size)
+{
+  AllocationHeader *header = (AllocationHeader *)malloc(sizeof(AllocationHeader) + size);
+  if (header == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  header->size = size;
+  allocations++;
+  liveBytes += size;
+  peakBytes = std::max(peakBytes, liveBytes);
+  return header + 1;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return operator new(size);
+  }
+  catch (...)
+  {
+    return NULL;
+  }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+  if (p == NULL)
+  {
+    return;
+  }
+  AllocationHeader *header = (AllocationHeader *)p - 1;
+  liveBytes -= header->size;
+  free(header);
+}
+
+void operator delete[](void *p) noexcept
+{
+  operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+AsyncWebServer server(80);
+DNSServer dns;
+
+AsyncWiFiManagerParameter *params[MAX_PARAMS];
+char paramIds[MAX_PARAMS][8];
+int failures = 0;
+
+class Measure
+{
+public:
+  Measure()
+  {
+    _allocations = allocations;
+    _live = liveBytes;
+    peakBytes = liveBytes;
+    _start = std::chrono::steady_clock::now();
+  }
+
+  void report(int aps, int paramCount, const char *name, size_t bytes)
+  {
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+    printf("%d %d %s %lld %u %u %u %ld\n", aps, paramCount, name, us / ITERATIONS, (unsigned)bytes,
+           (unsigned)((allocations - _allocations) / ITERATIONS), (unsigned)(peakBytes - _live),
+           (long)liveBytes - (long)_live);
+  }
+
+private:
+  size_t _allocations;
+  size_t _live;
+  std::chrono::steady_clock::time_point _start;
+};
+
+void fail(int aps, int paramCount, const char *name, const char *why)
+{
+  fprintf(stderr, "FAIL %d %d %s: %s\n", aps, paramCount, name, why);
+  failures++;
+}
+
+// networks with a few repeated SSIDs, so the dedup has something to do
+void makeScan(int n)
+{
+  srand(42);
+  WiFi.networks.clear();
+  for (int i = 0; i < n; i++)
+  {
+    WiFiClass::Network network;
+    snprintf(network.ssid, sizeof(network.ssid), "bench-%02d", i % 5 == 4 ? i - 1 : i);
+    for (int b = 0; b < 6; b++)
+    {
+      network.bssid[b] = rand() % 256;
+    }
+    network.rssi = -95 + rand() % 65;
+    network.channel = 1 + i % 13;
+    network.auth = i % 3 == 0 ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
+    WiFi.networks.push_back(network);
+  }
+}
+
+// one request through the server, the body as the client gets it
+int get(const char *url, boolean json, size_t mss, std::string *body)
+{
+  AsyncWebServerRequest request(url);
+  if (json)
+  {
+    request.addParam("format", "json");
+  }
+  server.handle(&request);
+  if (request.response() == NULL)
+  {
+    return 0;
+  }
+  request.drain(mss, body);
+  return request.response()->code;
+}
+
+void pageCase(AsyncWiFiManager *wm, int aps, int paramCount, const char *name, const char *url, boolean json)
+{
+  std::string page;
+  page.reserve(64 * 1024); // the client's buffer is not the page's cost
+  Measure measure;
+  for (int i = 0; i < ITERATIONS; i++)
+  {
+    page.clear();
+    if (get(url, json, MSS, &page) != 200)
+    {
+      fail(aps, paramCount, name, "no 200");
+      return;
+    }
+  }
+  measure.report(aps, paramCount, name, page.size());
+
+  std::string small;
+  get(url, json, SMALL_MSS, &small);
+  if (page.empty())
+  {
+    fail(aps, paramCount, name, "empty body");
+  }
+  else if (small != page)
+  {
+    fail(aps, paramCount, name, "body depends on the chunk size");
+  }
+  if (!json && paramCount > 0 && page.find("id='p0'") == std::string::npos && strstr(url, "scan") != NULL)
+  {
+    fail(aps, paramCount, name, "custom parameters missing");
+  }
+}
+
+void runCase(int aps, int paramCount)
+{
+  AsyncWiFiManager *wm = new AsyncWiFiManager(&server, &dns);
+  wm->setDebugOutput(false);
+  for (int i = 0; i < paramCount; i++)
+  {
+    wm->addParameter(params[i]);
+  }
+  makeScan(aps);
+  wm->startConfigPortalModeless("bench", NULL);
+
+  String list;
+  Measure measure;
+  for (int i = 0; i < ITERATIONS; i++)
+  {
+    list = wm->scanModal();
+  }
+  measure.report(aps, paramCount, "scanModal", list.length());
+  list = String();
+
+#if WM_FEATURE_INFO
+  String info;
+  Measure infoMeasure;
+  for (int i = 0; i < ITERATIONS; i++)
+  {
+    info = wm->infoAsString();
+  }
+  infoMeasure.report(aps, paramCount, "infoAsString", info.length());
+  info = String();
+#endif
+
+  pageCase(wm, aps, paramCount, "root", "/wifi", false);
+  pageCase(wm, aps, paramCount, "handleWifi", "/api/v2/wifi/scan", false);
+  pageCase(wm, aps, paramCount, "handleWifiJson", "/api/v2/wifi/scan", true);
+
+  delete wm;
+}
+
+int main()
+{
+  for (int i = 0; i < MAX_PARAMS; i++)
+  {
+    snprintf(paramIds[i], sizeof(paramIds[i]), "p%d", i);
+    params[i] = new AsyncWiFiManagerParameter(paramIds[i], paramIds[i], "value", 40);
+  }
+
+  printf("aps params case us_per_call bytes allocs_per_call peak_bytes leaked_bytes\n");
+  const int apCounts[] = {0, 1, 10, 32, 64, MAX_APS};
+  const int paramCounts[] = {0, MAX_PARAMS / 2, MAX_PARAMS};
+  for (int aps : apCounts)
+  {
+    for (int paramCount : paramCounts)
+    {
+      runCase(aps, paramCount);
+    }
+  }
+  printf("done, %d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Compress the portal's static assets into a PROGMEM header.
+
+Reads assets/wm.css, assets/wm.js and assets/lock.png, gzips them (unless
+that would make them bigger) and writes src/ESPAsyncWiFiManagerAssets.h.
+Every asset gets an ETag derived from its
+content, and pages link to it with that tag in the query string, so browsers
+can cache the files for a long time and still pick up a new firmware build.
+
+Run it after editing anything under assets/:
+
+    python3 tools/embed_assets.py
+"""
+
+import gzip
+import hashlib
+import os
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+ASSETS = os.path.join(ROOT, "assets")
+OUTPUT = os.path.join(ROOT, "src", "ESPAsyncWiFiManagerAssets.h")
+
+# (symbol, url, file, content type), lock.png first so the stylesheet can
+# reference its versioned url
+ENTRIES = [
+    ("LOCK", "/wm-lock.png", "lock.png", "image/png"),
+    ("CSS", "/wm.css", "wm.css", "text/css"),
+    ("JS", "/wm.js", "wm.js", "application/javascript"),
+]
+
+
+def c_array(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    urls = {}
+    out = [
+        "// generated by tools/embed_assets.py from assets/, do not edit",
+        "",
+        "#ifndef ESPAsyncWiFiManagerAssets_h",
+        "#define ESPAsyncWiFiManagerAssets_h",
+        "",
+    ]
+    table = []
+    for symbol, url, name, content_type in ENTRIES:
+        with open(os.path.join(ASSETS, name), "rb") as f:
+            data = f.read()
+        if name == "wm.css":
+            data = data.replace(b"@LOCK_URL@", urls["LOCK"].encode())
+            data = b"".join(line.strip() for line in data.splitlines())
+        elif name == "wm.js":
+            data = data.strip()
+        etag = hashlib.sha1(data).hexdigest()[:8]
+        urls[symbol] = "%s?v=%s" % (url, etag)
+        packed = gzip.compress(data, 9, mtime=0)
+        gzipped = len(packed) < len(data)
+        if gzipped:
+            out.append("// %s: %d bytes, %d gzipped" % (name, len(data), len(packed)))
+        else:
+            # already compressed formats like png only grow
+            packed = data
+            out.append("// %s: %d bytes, stored" % (name, len(data)))
+        out.append("const uint8_t WM_ASSET_%s[] PROGMEM = {" % symbol)
+        out.append(c_array(packed))
+        out.append("};")
+        out.append("")
+        table.append('  {"%s", "%s", WM_ASSET_%s, sizeof(WM_ASSET_%s), "\\"%s\\"", %s},'
+                     % (url, content_type, symbol, symbol, etag, "true" if gzipped else "false"))
+
+    out.append("const AsyncWiFiManagerAsset WM_ASSETS[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("")
+    out.append('const char HTTP_HEAD_ASSETS[] PROGMEM = "'
+               '<link rel=\\"stylesheet\\" href=\\"%s\\"><script src=\\"%s\\"></script>";'
+               % (urls["CSS"], urls["JS"]))
+    out.append("")
+    out.append("#endif")
+    out.append("")
+
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
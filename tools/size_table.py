@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Build a sketch once per feature configuration and print its size.
+
+Every configuration turns some WM_FEATURE_* switches of
+src/ESPAsyncWiFiManagerConfig.h off through compiler.cpp.extra_flags, the
+table lists flash and RAM as arduino-cli reports them and the saving against
+the full build. Needs arduino-cli with the core of the board installed:
+
+    python3 tools/size_table.py esp8266:esp8266:nodemcuv2
+    python3 tools/size_table.py esp32:esp32:esp32 examples/ModelessConnect
+"""
+
+import os
+import re
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# (name, defines), the first one is the baseline
+CONFIGS = [
+    ("full", []),
+    ("no stand alone", ["WM_FEATURE_STAND_ALONE=0"]),
+    ("no STA api", ["WM_FEATURE_STA_API=0"]),
+    ("no static IP", ["WM_FEATURE_STATIC_IP=0"]),
+    ("no info", ["WM_FEATURE_INFO=0"]),
+    ("no duplicate removal", ["WM_FEATURE_REMOVE_DUPLICATES=0"]),
+    ("no logs", ["WM_LOG_LEVEL=0"]),
+    ("minimal", ["WM_FEATURE_STAND_ALONE=0", "WM_FEATURE_STA_API=0", "WM_FEATURE_STATIC_IP=0",
+                 "WM_FEATURE_INFO=0", "WM_FEATURE_REMOVE_DUPLICATES=0", "WM_LOG_LEVEL=0"]),
+]
+
+FLASH = re.compile(r"Sketch uses (\d+) bytes")
+RAM = re.compile(r"Global variables use (\d+) bytes")
+
+
+def build(fqbn, sketch, defines):
+    flags = " ".join("-D" + d for d in defines)
+    result = subprocess.run(
+        ["arduino-cli", "compile", "--fqbn", fqbn, "--library", ROOT, "--clean",
+         "--build-property", "compiler.cpp.extra_flags=" + flags, sketch],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    flash = FLASH.search(result.stdout)
+    ram = RAM.search(result.stdout)
+    if result.returncode != 0 or flash is None or ram is None:
+        sys.stderr.write(result.stdout)
+        raise SystemExit("build failed: %s" % (flags or "full"))
+    return int(flash.group(1)), int(ram.group(1))
+
+
+def main():
+    if len(sys.argv) < 2:
+        raise SystemExit(__doc__)
+    fqbn = sys.argv[1]
+    sketch = sys.argv[2] if len(sys.argv) > 2 else os.path.join(ROOT, "examples", "AutoConnect")
+
+    print("| configuration | flash | saved | RAM | saved |")
+    print("|---|---:|---:|---:|---:|")
+    base = None
+    for name, defines in CONFIGS:
+        flash, ram = build(fqbn, sketch, defines)
+        if base is None:
+            base = (flash, ram)
+        print("| %s | %d | %d | %d | %d |" % (name, flash, base[0] - flash, ram, base[1] - ram))
+
+
+if __name__ == "__main__":
+    main()